@@ -0,0 +1,122 @@
+#!/usr/bin/env node
+// Headless benchmark of the WebAssembly build. Runs the engine's bench
+// command repeatedly and prints the results as JSON.
+//
+// Usage: node benchmark.js [--hash 16] [--threads 1] [--depth 13]
+//                          [--positions file] [--runs 5] [--module ./stockfish.js]
+//                          [--simd yes]
+//
+// The position file has one FEN per line. The module has no filesystem, so
+// each position is set up with 'position fen' and searched by 'bench ...
+// current', with a fresh hash table. The default positions are searched by
+// a single 'bench' in one go, exactly like the native build does.
+//
+// With --simd no, stockfish.wasm is loaded even where stockfish-simd.wasm
+// could be used, to compare both.
+//
+// Older versions of node need --experimental-wasm-threads
+// --experimental-wasm-bulk-memory.
+
+const fs = require('fs');
+const path = require('path');
+
+function parseArgs(argv) {
+  const args = {
+    hash: 16,
+    threads: 1,
+    depth: 13,
+    positions: null,
+    runs: 5,
+    module: './stockfish.js',
+    simd: 'yes',
+  };
+  for (let i = 0; i < argv.length; i += 2) {
+    const key = argv[i].replace(/^--/, '');
+    if (!(key in args) || i + 1 >= argv.length) {
+      console.error(`Unknown or incomplete argument: ${argv[i]}`);
+      process.exit(2);
+    }
+    args[key] = typeof args[key] === 'number' ? parseInt(argv[i + 1], 10) : argv[i + 1];
+  }
+  return args;
+}
+
+function stats(values) {
+  const mean = values.reduce((a, b) => a + b, 0) / values.length;
+  const variance = values.length > 1
+    ? values.reduce((a, b) => a + (b - mean) * (b - mean), 0) / (values.length - 1)
+    : 0;
+  return { mean, stddev: Math.sqrt(variance) };
+}
+
+async function main() {
+  const args = parseArgs(process.argv.slice(2));
+  const fens = args.positions
+    ? fs.readFileSync(args.positions, 'utf8').split('\n').map(l => l.trim()).filter(l => l)
+    : null;
+
+  // bench writes its summary to stderr, one line at a time
+  let pending = null;
+  let summary = {};
+  const printErr = line => {
+    const m = /^(Total time \(ms\)|Nodes searched) *: (\d+)/.exec(line);
+    if (m) summary[m[1] === 'Nodes searched' ? 'nodes' : 'time'] = parseInt(m[2], 10);
+    if (line.startsWith('Nodes/second') && pending) {
+      const resolve = pending;
+      pending = null;
+      resolve(summary);
+      summary = {};
+    }
+  };
+
+  const Stockfish = require(path.resolve(args.module));
+  const sf = await Stockfish({ printErr, simd: args.simd !== 'no' });
+  sf.addMessageListener(() => {}); // Discard search output
+
+  const bench = (command) => new Promise(resolve => {
+    pending = resolve;
+    sf.postMessage(command);
+  });
+
+  const run = async () => {
+    if (!fens) return bench(`bench ${args.hash} ${args.threads} ${args.depth} default depth`);
+
+    const total = { time: 0, nodes: 0 };
+    for (const fen of fens) {
+      sf.postMessage(`position fen ${fen}`);
+      const result = await bench(`bench ${args.hash} ${args.threads} ${args.depth} current depth`);
+      total.time += result.time;
+      total.nodes += result.nodes;
+    }
+    return total;
+  };
+
+  const runs = [];
+  for (let i = 0; i < args.runs; i++) {
+    const result = await run();
+    result.nps = Math.floor(1000 * result.nodes / result.time);
+    runs.push(result);
+  }
+
+  const report = {
+    config: {
+      hash: args.hash,
+      threads: args.threads,
+      depth: args.depth,
+      positions: args.positions || 'default',
+      runs: args.runs,
+    },
+    runs,
+  };
+  for (const key of ['time', 'nodes', 'nps']) report[key] = stats(runs.map(r => r[key]));
+
+  console.log(JSON.stringify(report, null, 2));
+
+  sf.terminate();
+  process.exit(0);
+}
+
+main().catch(err => {
+  console.error(err);
+  process.exit(1);
+});
@@ -77,6 +77,13 @@ bool Bitbases::probe(Square wksq, Square wpsq, Square bksq, Color stm) {
 }
 
 
+/// Bitbases::memory() returns the size of the KPK bitbase in bytes
+
+size_t Bitbases::memory() {
+  return sizeof(KPKBitbase);
+}
+
+
 void Bitbases::init() {
 
   std::vector<KPKPosition> db(MAX_INDEX);
@@ -29,6 +29,7 @@ namespace Bitbases {
 
 void init();
 bool probe(Square wksq, Square wpsq, Square bksq, Color us);
+size_t memory();
 
 }
 
@@ -36,6 +37,7 @@ namespace Bitboards {
 
 void init();
 const std::string pretty(Bitboard b);
+size_t memory();
 
 }
 
@@ -0,0 +1,262 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#include <emscripten/threading.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+#include "channel.h"
+#include "engine.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+#include "uci.h"
+
+#ifdef __EMSCRIPTEN__
+
+namespace {
+
+CommandRing Ring; // Shared with pre.js
+
+
+/// CommandReader is the engine side consumer of the command ring. It runs on
+/// its own thread, so unlike the browser main thread it is allowed to block,
+/// both on the futex while the ring is empty and while search threads are
+/// still starting up.
+
+class CommandReader {
+
+  NativeThread stdThread;
+
+public:
+  CommandReader() : stdThread(&CommandReader::idle_loop, this) {}
+  void idle_loop();
+};
+
+
+/// CommandReader::idle_loop() consumes commands from the ring and parks on
+/// a futex on the head counter when there are none. pre.js wakes us up with
+/// Atomics.notify() after publishing new commands.
+
+void CommandReader::idle_loop() {
+
+  std::string cmd;
+  uint32_t tail = Ring.tail.load(std::memory_order_relaxed);
+
+  while (true)
+  {
+      uint32_t head = Ring.head.load(std::memory_order_acquire);
+
+      if (head == tail)
+      {
+          emscripten_futex_wait(&Ring.head, head, INFINITY);
+          continue;
+      }
+
+      while (tail != head)
+      {
+          char c = Ring.data[tail++ & (CommandRing::Size - 1)];
+
+          if (c != '\n')
+          {
+              cmd += c;
+              continue;
+          }
+
+          // Release the space before executing, a command like 'bench' may
+          // take a while and the producer can already refill the ring.
+          Ring.tail.store(tail, std::memory_order_release);
+          UCI::execute(cmd);
+          cmd.clear();
+      }
+
+      Ring.tail.store(tail, std::memory_order_release);
+  }
+}
+
+} // namespace
+
+
+/// uci_command_ring() returns the address of the ring, so that pre.js can
+/// find it in the heap.
+
+EMSCRIPTEN_KEEPALIVE extern "C" CommandRing* uci_command_ring() {
+  return &Ring;
+}
+
+
+/// Channel::init() launches the command reader thread. Called once at startup
+/// after the search threads have been created.
+
+void Channel::init() {
+
+  new CommandReader(); // Runs for the lifetime of the module
+}
+
+#endif // #ifdef __EMSCRIPTEN__
+
+
+/// engine_create() reserves the id of a new engine, which is set up when it
+/// receives its first command. See Engine.
+
+EMSCRIPTEN_KEEPALIVE extern "C" int engine_create() {
+  return Engine::reserve();
+}
+
+
+namespace {
+
+/// write_pv() fills the progress buffer of the current engine with one record
+/// per MultiPV line, like UCI::pv() formats them, guarded by the sequence
+/// counter. Mate and stalemate at the root come with a MOVE_NONE root move,
+/// written as a line without moves.
+
+ProgressBuffer& write_pv(const Position& pos, const Search::RootMoves& rootMoves,
+                         Depth depth, Value alpha, Value beta) {
+
+  TimePoint elapsed = std::max(time_manager().elapsed(), TimePoint(1)); // Avoid divide by zero
+  size_t pvIdx = pos.this_thread()->pvIdx;
+  size_t multiPV = std::min((size_t)search_limits().multiPV, rootMoves.size());
+  uint64_t nodesSearched = threads().nodes_searched();
+  int hashfull = tt().hashfull();
+  ProgressBuffer& Progress = CurrentEngine->progress;
+  uint32_t sequence = Progress.sequence.load(std::memory_order_relaxed);
+  uint32_t count = 0;
+
+  Progress.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  for (size_t i = 0; i < multiPV; ++i)
+  {
+      bool updated = rootMoves[i].score != -VALUE_INFINITE;
+
+      if (depth == 1 && !updated)
+          continue;
+
+      Depth d = updated ? depth : depth - 1;
+      Value v = updated ? rootMoves[i].score : rootMoves[i].previousScore;
+      PvInfo& info = Progress.lines[count++];
+
+      info.nodes    = nodesSearched;
+      info.nps      = nodesSearched * 1000 / elapsed;
+      info.time     = int32_t(elapsed);
+      info.depth    = d;
+      info.selDepth = rootMoves[i].selDepth;
+      info.multiPV  = int32_t(i + 1);
+      info.mate     = abs(v) >= VALUE_MATE_IN_MAX_PLY;
+      info.score    = info.mate ? (v > 0 ? VALUE_MATE - v + 1 : -VALUE_MATE - v) / 2
+                                : v * 100 / PawnValueEg;
+      info.bound    = i != pvIdx ? BOUND_EXACT
+                    : v >= beta  ? BOUND_LOWER
+                    : v <= alpha ? BOUND_UPPER : BOUND_EXACT;
+      info.hashfull = int16_t(hashfull);
+      info.wdl[0]   = int16_t(UCI::win_rate_model( v, pos.game_ply()));
+      info.wdl[2]   = int16_t(UCI::win_rate_model(-v, pos.game_ply()));
+      info.wdl[1]   = int16_t(1000 - info.wdl[0] - info.wdl[2]);
+      info.pvLength = rootMoves[i].pv[0] == MOVE_NONE ? 0
+                    : uint16_t(std::min(rootMoves[i].pv.size(), size_t(MAX_PLY)));
+
+      for (int j = 0; j < info.pvLength; ++j)
+          info.pv[j] = uint16_t(rootMoves[i].pv[j]);
+  }
+
+  Progress.count = count;
+  Progress.sequence.store(sequence + 2, std::memory_order_release);
+
+  return Progress;
+}
+
+} // namespace
+
+
+/// Channel::publish_pv() is the binary counterpart of UCI::pv(), used when the
+/// "Binary Info" option is set and for analyze requests. It fills the progress
+/// buffer and asynchronously notifies pre.js, which decodes the records
+/// straight from the heap. No strings are formatted.
+
+void Channel::publish_pv(const Position& pos, Depth depth, Value alpha, Value beta) {
+
+  ProgressBuffer& Progress = write_pv(pos, pos.this_thread()->rootMoves, depth, alpha, beta);
+
+#ifdef __EMSCRIPTEN__
+  MAIN_THREAD_ASYNC_EM_ASM({ Module['onProgress']($0, $1); }, CurrentEngine->id, &Progress);
+#else
+  (void)Progress;
+#endif
+}
+
+
+/// Channel::publish_result() reports the final result of an analyze request,
+/// in place of 'bestmove'. The PV lines are written to the progress buffer
+/// like by publish_pv(), but pre.js is notified synchronously, so that the
+/// lines can not be overwritten by a following search before they are read.
+
+void Channel::publish_result(const Position& pos, Depth depth, Move ponder) {
+
+  Search::RootMoves rootMoves = pos.this_thread()->rootMoves;
+
+  if (rootMoves[0].pv[0] == MOVE_NONE)
+      rootMoves[0].score = pos.checkers() ? -VALUE_MATE : VALUE_DRAW;
+
+  ProgressBuffer& Progress = write_pv(pos, rootMoves, depth, -VALUE_INFINITE, VALUE_INFINITE);
+
+#ifdef __EMSCRIPTEN__
+  MAIN_THREAD_EM_ASM({ Module['onResult']($0, $1, $2, $3, $4, $5); },
+                     CurrentEngine->id, search_limits().request, int(rootMoves[0].pv[0]), int(ponder),
+                     pos.is_chess960(), &Progress);
+#else
+  (void)Progress, (void)ponder;
+#endif
+}
+
+
+/// Channel::complete() tells pre.js that the request with the given id, made
+/// by one of the commands that exchange data through the heap (evalbatch,
+/// hashexport, hashimport), is done. Data and size are request specific.
+
+void Channel::complete(int request, const void* data, size_t size) {
+
+#ifdef __EMSCRIPTEN__
+  MAIN_THREAD_ASYNC_EM_ASM({ Module['onComplete']($0, $1, $2, $3); },
+                           CurrentEngine->id, request, data, size);
+#else
+  (void)request, (void)data, (void)size;
+#endif
+}
+
+
+/// Channel::reject() tells pre.js that the request with the given id was not
+/// run, because the engine is busy with a search (see UCI::execute()).
+
+void Channel::reject(int request) {
+
+#ifdef __EMSCRIPTEN__
+  MAIN_THREAD_ASYNC_EM_ASM({ Module['onReject']($0, $1); }, CurrentEngine->id, request);
+#else
+  (void)request;
+#endif
+}
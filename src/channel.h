@@ -0,0 +1,116 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHANNEL_H_INCLUDED
+#define CHANNEL_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+#include "types.h"
+
+class Position;
+
+/// CommandRing is a lock-free single-producer/single-consumer queue of UCI
+/// commands in the shared wasm heap. The producer is pre.js on the browser
+/// main thread: it copies newline terminated commands into data[] and then
+/// publishes them by advancing head. The consumer is a dedicated engine
+/// thread that blocks on a futex on head while the queue is empty. Both
+/// counters are free running, so head - tail is the number of queued bytes.
+///
+/// The layout is shared with pre.js and must not be changed independently:
+///
+/// head        32 bit   offset 0
+/// tail        32 bit   offset 4
+/// data   Size bytes    offset 8
+
+struct CommandRing {
+
+  static constexpr uint32_t Size = 1 << 16; // Must be a power of 2
+
+  std::atomic<uint32_t> head, tail;
+  char data[Size];
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == 4, "Unexpected atomic size");
+
+
+/// PvInfo is the fixed layout record of a single MultiPV line, holding the
+/// same information as a UCI info line. Scores are in centipawns, or in moves
+/// if mate is set. The bound is BOUND_LOWER or BOUND_UPPER for a fail high or
+/// low, BOUND_EXACT otherwise. Moves are in the internal 16 bit encoding, see
+/// types.h. The layout is shared with pre.js:
+///
+/// nodes           64 bit   offset  0
+/// nps             64 bit   offset  8
+/// time            32 bit   offset 16
+/// depth           32 bit   offset 20
+/// seldepth        32 bit   offset 24
+/// multipv         32 bit   offset 28
+/// score           32 bit   offset 32
+/// mate             8 bit   offset 36
+/// bound            8 bit   offset 37
+/// hashfull        16 bit   offset 38
+/// wdl         3 x 16 bit   offset 40
+/// pv length       16 bit   offset 46
+/// pv    MAX_PLY x 16 bit   offset 48
+
+struct PvInfo {
+  uint64_t nodes;
+  uint64_t nps;
+  int32_t  time;
+  int32_t  depth;
+  int32_t  selDepth;
+  int32_t  multiPV;
+  int32_t  score;
+  uint8_t  mate;
+  uint8_t  bound;
+  int16_t  hashfull;
+  int16_t  wdl[3];
+  uint16_t pvLength;
+  uint16_t pv[MAX_PLY];
+};
+
+static_assert(sizeof(PvInfo) == 544, "Unexpected PvInfo size"); // Padded to 8 bytes
+
+
+/// ProgressBuffer holds the PV lines of the latest progress update of an
+/// engine. It is guarded by a sequence counter that is odd while the engine is
+/// writing, so a reader has to discard its copy if the counter was odd or
+/// changed in the meantime. Layout: sequence at offset 0, count at 4, lines
+/// at 8.
+
+struct ProgressBuffer {
+  std::atomic<uint32_t> sequence;
+  uint32_t count;
+  PvInfo lines[MAX_MOVES];
+};
+
+namespace Channel {
+
+void init();
+void publish_pv(const Position& pos, Depth depth, Value alpha, Value beta);
+void publish_result(const Position& pos, Depth depth, Move ponder);
+void complete(int request, const void* data = nullptr, size_t size = 0);
+void reject(int request);
+
+} // namespace Channel
+
+#endif // #ifndef CHANNEL_H_INCLUDED
@@ -88,6 +88,17 @@ namespace Endgames {
     add<KBPPKB>("KBPPKB");
     add<KRPPKRP>("KRPPKRP");
   }
+
+  // Estimated heap memory of a map: buckets, nodes and endgame objects
+  template<typename T>
+  size_t map_memory(const Map<T>& m) {
+    return  m.bucket_count() * sizeof(void*)
+          + m.size() * (sizeof(typename Map<T>::value_type) + sizeof(void*) + sizeof(EndgameBase<T>));
+  }
+
+  size_t memory() {
+    return map_memory(maps.first) + map_memory(maps.second);
+  }
 }
 
 
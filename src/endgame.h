@@ -101,6 +101,7 @@ namespace Endgames {
   extern std::pair<Map<Value>, Map<ScaleFactor>> maps;
 
   void init();
+  size_t memory();
 
   template<typename T>
   Map<T>& map() {
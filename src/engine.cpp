@@ -0,0 +1,112 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <map>
+
+#include "engine.h"
+
+thread_local Engine* CurrentEngine; // Set per thread, see Engine
+
+namespace {
+
+  // All engines by id. Only accessed by the thread running commands, except
+  // for the default engine, which is registered at startup. Destroyed engines
+  // stay in the map as nullptr, so their ids are not reused.
+  std::map<int, Engine*> Engines;
+
+  std::atomic<int> NextId(1);
+
+} // namespace
+
+
+/// Engine constructor sets up options and state for a new engine, including
+/// its threads and transposition table. The read-only tables must have been
+/// initialized before.
+
+Engine::Engine(int n) : id(n), options(), threads(), tt(), pawnsTable(), limits(), time(),
+                        progress(), states(new std::deque<StateInfo>(1)) {
+
+  Engine* caller = CurrentEngine;
+  CurrentEngine = this;
+
+  UCI::init(options);
+  threads.set(size_t(options["Threads"]));
+  tt.resize(size_t(options["Hash"])); // After threads are up
+  Search::clear(); // After threads are up
+  pos.set(UCI::StartFEN, false, &states->back(), threads.main());
+
+  CurrentEngine = caller;
+}
+
+
+/// Engine destructor stops and joins the engine's threads. The transposition
+/// table is freed with the engine.
+
+Engine::~Engine() {
+
+  Engine* caller = CurrentEngine;
+  CurrentEngine = this;
+
+  threads.stop = true;
+  threads.main()->wake_up();
+  threads.set(0);
+
+  CurrentEngine = caller != this ? caller : nullptr;
+}
+
+
+/// Engine::reserve() returns a fresh engine id. The engine itself is created
+/// lazily, when it receives its first command, on the thread that runs it.
+/// May be called from any thread.
+
+int Engine::reserve() {
+
+  return NextId++;
+}
+
+
+/// Engine::get() returns the engine with the given id, creating it if the id
+/// has been reserved but not used yet. Returns nullptr for unknown ids and
+/// destroyed engines.
+
+Engine* Engine::get(int n) {
+
+  auto it = Engines.find(n);
+
+  if (it != Engines.end())
+      return it->second;
+
+  if (n < 0 || n >= NextId)
+      return nullptr;
+
+  return Engines[n] = new Engine(n);
+}
+
+
+/// Engine::destroy() deletes the engine with the given id
+
+void Engine::destroy(int n) {
+
+  auto it = Engines.find(n);
+
+  if (it != Engines.end())
+      delete it->second, it->second = nullptr;
+}
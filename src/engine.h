@@ -0,0 +1,75 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENGINE_H_INCLUDED
+#define ENGINE_H_INCLUDED
+
+#include "channel.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+#include "uci.h"
+
+/// Engine holds everything that used to be global state: options, threads,
+/// transposition and shared pawn table, search limits, time management and
+/// the root position. Several engines can live side by side in one module,
+/// sharing memory, the worker pool and the read-only tables (bitboards, PSQT,
+/// endgames, ...).
+///
+/// Code always works on the current engine of the thread it runs on. The
+/// command reader switches engines per command, while search threads belong
+/// to the engine that created them for their whole lifetime (Thread::engine).
+
+struct Engine {
+
+  explicit Engine(int n);
+ ~Engine();
+
+  static int reserve();
+  static Engine* get(int n);
+  static void destroy(int n);
+
+  const int id; // 0 for the default engine
+  UCI::OptionsMap options;
+  ThreadPool threads;
+  TranspositionTable tt;
+  Pawns::SharedTable pawnsTable;
+  Search::LimitsType limits;
+  TimeManagement time;
+  ProgressBuffer progress;
+  StateListPtr states;
+  Position pos;
+};
+
+extern thread_local Engine* CurrentEngine;
+
+/// Accessors of the former global objects, resolved through the current
+/// engine. Each call loads the thread local pointer, so the search reaches
+/// its engine through Thread::engine instead.
+inline UCI::OptionsMap&    options()        { return CurrentEngine->options; }
+inline ThreadPool&         threads()        { return CurrentEngine->threads; }
+inline TranspositionTable& tt()             { return CurrentEngine->tt; }
+inline Pawns::SharedTable& pawns_table()    { return CurrentEngine->pawnsTable; }
+inline Search::LimitsType& search_limits()  { return CurrentEngine->limits; }
+inline TimeManagement&     time_manager()   { return CurrentEngine->time; }
+
+#endif // #ifndef ENGINE_H_INCLUDED
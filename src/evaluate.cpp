@@ -19,12 +19,16 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstring>   // For std::memset
 #include <iomanip>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "material.h"
 #include "pawns.h"
@@ -280,9 +284,13 @@ namespace {
     for (Square s = *pl; s != SQ_NONE; s = *++pl)
     {
         // Find attacked squares, including x-ray attacks for bishops and rooks
+#ifdef INCREMENTAL_ATTACKS
+        b = pos.piece_attacks(s);
+#else
         b = Pt == BISHOP ? attacks_bb<BISHOP>(s, pos.pieces() ^ pos.pieces(QUEEN))
           : Pt ==   ROOK ? attacks_bb<  ROOK>(s, pos.pieces() ^ pos.pieces(QUEEN) ^ pos.pieces(Us, ROOK))
                          : attacks_bb<Pt>(s, pos.pieces());
+#endif
 
         if (pos.blockers_for_king(Us) & s)
             b &= line_bb(pos.square<KING>(Us), s);
@@ -906,7 +914,71 @@ make_v:
 /// evaluation of the position from the point of view of the side to move.
 
 Value Eval::evaluate(const Position& pos) {
-  return Evaluation<NO_TRACE>(pos).value();
+
+  Cache& cache = pos.this_thread()->evalCache;
+
+  if (!cache.enabled())
+      return Evaluation<NO_TRACE>(pos).value();
+
+  Key key = pos.key() ^ make_key(uint64_t(uint32_t(pos.this_thread()->contempt)) << 16 | pos.rule50_count());
+  Value v;
+
+  if (!cache.probe(key, v))
+      cache.save(key, v = Evaluation<NO_TRACE>(pos).value());
+
+  return v;
+}
+
+
+/// Cache::resize() sets the size of the cache in bytes, 0 to disable it
+
+void Eval::Cache::resize(size_t bytes) {
+
+  std::vector<uint64_t>(bytes / sizeof(uint64_t)).swap(slots);
+  clear();
+}
+
+
+/// Cache::clear() empties the cache and resets its statistics
+
+void Eval::Cache::clear() {
+
+  std::fill(slots.begin(), slots.end(), 0);
+  probes = hits = 0;
+}
+
+
+/// evaluate_batch() evaluates many positions at once, split across the threads
+/// of the current engine, each one using its own pawn and material tables.
+/// The positions are given as FENs, each one terminated by a newline. The
+/// results are written as by evaluate(), or VALUE_NONE for positions in check
+/// or missing from the list.
+
+void Eval::evaluate_batch(const char* fens, size_t count, int16_t* results) {
+
+  std::vector<std::string> positions;
+  bool chess960 = options()["UCI_Chess960"];
+  std::atomic<size_t> next(0);
+
+  for (const char* end; positions.size() < count && (end = std::strchr(fens, '\n')); fens = end + 1)
+      positions.emplace_back(fens, end);
+
+  std::fill(results + positions.size(), results + count, int16_t(VALUE_NONE));
+
+  threads().execute([&](Thread& th) {
+
+      StateInfo st;
+      Position pos;
+      size_t i;
+
+      th.contempt = SCORE_ZERO; // Like trace(), no dynamic contempt
+
+      while ((i = next++) < positions.size())
+      {
+          pos.set(positions[i], chess960, &st, &th);
+          results[i] = int16_t(pos.checkers() ? VALUE_NONE : evaluate(pos));
+      }
+  });
 }
 
 
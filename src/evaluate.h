@@ -22,16 +22,52 @@
 #define EVALUATE_H_INCLUDED
 
 #include <string>
+#include <vector>
 
+#include "misc.h"
 #include "types.h"
 
 class Position;
 
 namespace Eval {
 
+/// Cache is a direct mapped cache of a thread for the results of evaluate(),
+/// sized by its share of "Eval Cache". Each slot packs the low 48 bits of the
+/// key and the 16 bit value into one word. The key covers everything
+/// evaluate() depends on besides the position: contempt and the 50 move
+/// counter.
+
+class Cache {
+
+  std::vector<uint64_t> slots;
+
+public:
+  void resize(size_t bytes);
+  void clear();
+  bool enabled() const { return !slots.empty(); }
+  size_t memory() const { return slots.size() * sizeof(uint64_t); }
+
+  bool probe(Key key, Value& v) {
+    uint64_t slot = slots[mul_hi64(key, slots.size())];
+    ++probes;
+    if ((slot >> 16) != (key & 0xFFFFFFFFFFFFULL))
+        return false;
+    ++hits;
+    v = Value(int16_t(slot));
+    return true;
+  }
+
+  void save(Key key, Value v) {
+    slots[mul_hi64(key, slots.size())] = key << 16 | uint16_t(v);
+  }
+
+  uint64_t probes, hits;
+};
+
 std::string trace(const Position& pos);
 
 Value evaluate(const Position& pos);
+void evaluate_batch(const char* fens, size_t count, int16_t* results);
 }
 
 #endif // #ifndef EVALUATE_H_INCLUDED
@@ -21,7 +21,9 @@
 #include <iostream>
 
 #include "bitboard.h"
+#include "channel.h"
 #include "endgame.h"
+#include "engine.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
@@ -36,16 +38,22 @@ int main(int argc, char* argv[]) {
 
   std::cout << engine_info() << std::endl;
 
-  UCI::init(Options);
-  Tune::init();
   PSQT::init();
   Bitboards::init();
   Position::init();
   Bitbases::init();
   Endgames::init();
-  Threads.set(size_t(Options["Threads"]));
-  TT.resize(Options["Hash"]); // After threads are up
-  Search::clear(); // After threads are up
+  CurrentEngine = Engine::get(0); // After tables are set up
+  Tune::init();
+  set_output_interval(options()["Output Interval"]);
+
+#ifdef __EMSCRIPTEN__
+  Channel::init(); // After everything is set up
+#else
+  UCI::loop(argc, argv);
+
+  threads().set(0);
+#endif
 
   return 0;
 }
@@ -0,0 +1,3 @@
+// Limits of the memory64 build (ARCH=wasm64) for the memory reservation in
+// pre.js, which is loaded after this file. See MAXIMUM_MEMORY in the Makefile.
+var MEMORY64_MAXIMUM_MEMORY = 17179869184;
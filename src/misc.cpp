@@ -41,6 +41,8 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -52,6 +54,7 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <sys/mman.h>
 #endif
 
+#include "engine.h"
 #include "misc.h"
 #include "thread.h"
 
@@ -126,6 +129,96 @@ public:
   }
 };
 
+
+/// OutputBatcher sits between cout and its original stream buffer and holds
+/// back 'info' lines, so that a burst of search output reaches the GUI as one
+/// batch instead of line by line. Pending lines are released once the output
+/// interval has elapsed, or as soon as any other line, like 'bestmove' or
+/// 'readyok', is written. A pending line is replaced in place by a newer one
+/// with the same multipv index. With an interval of 0 output is unchanged.
+/// Lines of engines other than the default one are prefixed by '@<id> ', so
+/// that they can be told apart. Accessed under the IO lock, like any other
+/// output.
+
+class OutputBatcher: public streambuf {
+
+  OutputBatcher() : buf(cout.rdbuf()) { cout.rdbuf(this); }
+ ~OutputBatcher() { flush(); cout.rdbuf(buf); }
+
+  streambuf* buf;
+  string line;
+  vector<pair<int, string>> pending; // (engine id << 16 | multipv index or 0, line)
+  TimePoint interval = 0, lastFlush = 0;
+
+  int sync() override { return buf->pubsync(); }
+
+  int overflow(int c) override {
+
+    int id = CurrentEngine ? CurrentEngine->id : 0;
+
+    if (line.empty() && pending.empty() && !interval && !id)
+        return buf->sputc((char)c);
+
+    if (line.empty() && id)
+        line = "@" + to_string(id) + " ";
+
+    line += (char)c;
+
+    if (c == '\n')
+        add(line), line.clear();
+
+    return c;
+  }
+
+  void add(const string& l) {
+
+    size_t start = l[0] == '@' ? l.find(' ') + 1 : 0;
+
+    if (l.compare(start, 5, "info "))
+    {
+        pending.emplace_back(0, l);
+        flush();
+        return;
+    }
+
+    size_t idx = l.find(" multipv ");
+    int multiPV = idx != string::npos ? atoi(l.c_str() + idx + 9) : 0;
+    int key = multiPV ? (CurrentEngine ? CurrentEngine->id : 0) << 16 | multiPV : 0;
+
+    auto it = find_if(pending.begin(), pending.end(),
+                      [&](const pair<int, string>& p) { return key && p.first == key; });
+
+    if (it != pending.end())
+        it->second = l;
+    else
+        pending.emplace_back(key, l);
+
+    poll();
+  }
+
+  void flush() {
+
+    for (const auto& p : pending)
+        buf->sputn(p.second.c_str(), p.second.size());
+
+    pending.clear();
+    buf->pubsync();
+    lastFlush = now();
+  }
+
+  void poll() {
+
+    if (!pending.empty() && now() - lastFlush >= interval)
+        flush();
+  }
+
+public:
+  static OutputBatcher& get() { static OutputBatcher b; return b; }
+
+  static void set_interval(TimePoint ms) { get().interval = ms; get().poll(); }
+  static void release(bool force) { force ? get().flush() : get().poll(); }
+};
+
 } // namespace
 
 /// engine_info() returns the full name of the current Stockfish version. This
@@ -267,6 +360,25 @@ std::ostream& operator<<(std::ostream& os, SyncCout sc) {
 void start_logger(const std::string& fname) { Logger::start(fname); }
 
 
+/// set_output_interval() sets how long 'info' lines may be held back, in
+/// milliseconds, and flush_output() writes them out if that time is up, or
+/// unconditionally if force is set. Both take the IO lock.
+
+void set_output_interval(int ms) {
+
+  cout << IO_LOCK;
+  OutputBatcher::set_interval(ms);
+  cout << IO_UNLOCK;
+}
+
+void flush_output(bool force) {
+
+  cout << IO_LOCK;
+  OutputBatcher::release(force);
+  cout << IO_UNLOCK;
+}
+
+
 /// prefetch() preloads the given address in L1/L2 cache. This is a non-blocking
 /// function that doesn't stall the CPU waiting for data to be loaded from memory,
 /// which can be quite slow.
@@ -33,6 +33,8 @@ const std::string engine_info(bool to_uci = false);
 const std::string compiler_info();
 void prefetch(void* addr);
 void start_logger(const std::string& fname);
+void set_output_interval(int ms);
+void flush_output(bool force = false);
 void* aligned_ttmem_alloc(size_t size, void*& mem);
 void aligned_ttmem_free(void* mem); // nop if mem == nullptr
 
@@ -53,6 +55,7 @@ inline TimePoint now() {
 template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+  size_t memory() const { return table.size() * sizeof(Entry); }
 
 private:
   std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
@@ -110,8 +113,12 @@ public:
   { return T(rand64() & rand64() & rand64()); }
 };
 
+/// mul_hi64() returns the upper 64 bits of a * b. WebAssembly has no 128-bit
+/// multiply, so there __int128 would be a call to __multi3 computing the same
+/// four partial products as the portable version below.
+
 inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
-#if defined(__GNUC__) && defined(IS_64BIT)
+#if defined(__GNUC__) && defined(IS_64BIT) && !defined(__wasm__)
     __extension__ typedef unsigned __int128 uint128;
     return ((uint128)a * (uint128)b) >> 64;
 #else
@@ -71,6 +71,20 @@ struct Stats : public std::array<Stats<T, D, Sizes...>, Size>
 
     typedef StatsEntry<T, D> entry;
     entry* p = reinterpret_cast<entry*>(this);
+
+#ifdef USE_WASM_SIMD
+    // The histories are large arrays of int16_t, store 8 values at a time
+    if (sizeof(entry) == sizeof(int16_t) && sizeof(*this) % 16 == 0)
+    {
+        const v128_t vv = wasm_i16x8_splat(int16_t(v));
+        char* q = reinterpret_cast<char*>(p);
+
+        for (char* end = q + sizeof(*this); q < end; q += 16)
+            wasm_v128_store(q, vv);
+        return;
+    }
+#endif
+
     std::fill(p, p + sizeof(*this) / sizeof(entry), v);
   }
 };
@@ -20,8 +20,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>   // For std::memcpy
 
 #include "bitboard.h"
+#include "engine.h"
 #include "pawns.h"
 #include "position.h"
 #include "thread.h"
@@ -193,20 +195,94 @@ namespace Pawns {
 Entry* probe(const Position& pos) {
 
   Key key = pos.pawn_key();
-  Entry* e = pos.this_thread()->pawnsTable[key];
+  Thread* th = pos.this_thread();
+  Entry* e = th->pawnsTable ? (*th->pawnsTable)[key] : &th->pawnsEntry;
 
   if (e->key == key)
       return e;
 
+  if (!th->pawnsTable && th->engine->pawnsTable.load(key, *e))
+      return e;
+
   e->key = key;
   e->blockedCount = 0;
   e->scores[WHITE] = evaluate<WHITE>(pos, e);
   e->scores[BLACK] = evaluate<BLACK>(pos, e);
 
+  if (!th->pawnsTable)
+      th->engine->pawnsTable.store(*e);
+
   return e;
 }
 
 
+namespace {
+
+  static_assert(sizeof(Entry) % sizeof(Key) == 0, "Entry not a multiple of 64 bits");
+
+  // The checksum of an entry is the xor of all its 64 bit words
+  Key checksum(const Entry& e) {
+
+    Key words[sizeof(Entry) / sizeof(Key)], sum = 0;
+    std::memcpy(words, &e, sizeof(Entry));
+
+    for (Key w : words)
+        sum ^= w;
+
+    return sum;
+  }
+
+} // namespace
+
+
+/// SharedTable::resize() sets the size of the shared table in megabytes. With
+/// a size of 0 the engine's threads go back to their own tables, otherwise
+/// their tables are freed, to save memory with many threads.
+
+void SharedTable::resize(size_t mbSize) {
+
+  size_t slotCount = mbSize * 1024 * 1024 / sizeof(Slot);
+
+  if (slotCount == slots.size())
+      return;
+
+  threads().main()->wait_for_search_finished();
+
+  std::vector<Slot>(slotCount).swap(slots);
+
+  for (Thread* th : threads())
+  {
+      th->pawnsTable.reset(enabled() ? nullptr : new Table);
+      th->pawnsEntry = Entry();
+  }
+}
+
+
+/// SharedTable::load() copies the entry for the given key, if there is a valid
+/// one, and returns whether it was found.
+
+bool SharedTable::load(Key key, Entry& e) const {
+
+  const Slot& slot = slots[mul_hi64(key, slots.size())];
+
+  std::memcpy(&e, &slot.entry, sizeof(Entry));
+
+  return e.key == key && checksum(e) == slot.check;
+}
+
+
+/// SharedTable::store() copies the given entry into its slot, replacing any
+/// other entry there.
+
+void SharedTable::store(const Entry& e) {
+
+  Slot& slot = slots[mul_hi64(e.key, slots.size())];
+
+  std::memcpy(&slot.entry, &e, sizeof(Entry));
+  slot.check = checksum(e);
+}
+
+
 /// Entry::evaluate_shelter() calculates the shelter bonus and the storm
 /// penalty for a king, looking at the king file and the two closest files.
 
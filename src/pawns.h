@@ -21,6 +21,8 @@
 #ifndef PAWNS_H_INCLUDED
 #define PAWNS_H_INCLUDED
 
+#include <vector>
+
 #include "misc.h"
 #include "position.h"
 #include "types.h"
@@ -65,6 +67,31 @@ struct Entry {
 
 typedef HashTable<Entry, 131072> Table;
 
+
+/// SharedTable is a pawn hash table of a configurable size, shared by all
+/// threads of an engine instead of their own Table, see "Pawn Hash". It is not
+/// locked: each slot holds a copy of an Entry and a checksum of it, so that
+/// an entry torn by a concurrent write is detected and treated as a miss.
+/// Threads work on their own copy of the looked up entry.
+
+class SharedTable {
+
+  struct Slot {
+    Entry entry;
+    Key check;
+  };
+
+public:
+  void resize(size_t mbSize);
+  bool enabled() const { return !slots.empty(); }
+  size_t memory() const { return slots.size() * sizeof(Slot); }
+  bool load(Key key, Entry& e) const;
+  void store(const Entry& e);
+
+private:
+  std::vector<Slot> slots;
+};
+
 Entry* probe(const Position& pos);
 
 } // namespace Pawns
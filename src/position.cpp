@@ -26,6 +26,7 @@
 #include <sstream>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "misc.h"
 #include "movegen.h"
 #include "position.h"
@@ -352,6 +353,14 @@ void Position::set_state(StateInfo* si) const {
   for (Piece pc : Pieces)
       for (int cnt = 0; cnt < pieceCount[pc]; ++cnt)
           si->materialKey ^= Zobrist::psq[pc][cnt];
+
+#ifdef INCREMENTAL_ATTACKS
+  for (Bitboard b = pieces(KNIGHT, BISHOP) | pieces(ROOK, QUEEN); b; )
+  {
+      Square s = pop_lsb(&b);
+      si->pieceAttacks[s] = compute_piece_attacks(s);
+  }
+#endif
 }
 
 
@@ -461,6 +470,49 @@ Bitboard Position::slider_blockers(Bitboard sliders, Square s, Bitboard& pinners
 }
 
 
+#ifdef INCREMENTAL_ATTACKS
+
+/// Position::compute_piece_attacks() returns the squares attacked by the knight,
+/// bishop, rook or queen on the given square, as the evaluation sees them:
+/// bishops x-ray through queens, and rooks through queens and own rooks.
+
+Bitboard Position::compute_piece_attacks(Square s) const {
+
+  Piece pc = piece_on(s);
+
+  return type_of(pc) == BISHOP ? attacks_bb<BISHOP>(s, pieces() ^ pieces(QUEEN))
+       : type_of(pc) ==   ROOK ? attacks_bb<  ROOK>(s, pieces() ^ pieces(QUEEN) ^ pieces(color_of(pc), ROOK))
+                               : attacks_bb(type_of(pc), s, pieces());
+}
+
+
+/// Position::update_piece_attacks() is called by do_move() with the squares
+/// whose occupancy or piece has changed. It recomputes the attacks of the
+/// pieces on those squares and of the sliders whose attacks reach any of them.
+/// A ray only changes if a square on it up to its first blocker does, so all
+/// other attacks stay valid. Attacks stored for empty squares are stale.
+
+void Position::update_piece_attacks(Bitboard changed) {
+
+  Bitboard update = (pieces(KNIGHT, BISHOP) | pieces(ROOK, QUEEN)) & changed;
+
+  for (Bitboard b = (pieces(BISHOP, ROOK) | pieces(QUEEN)) & ~changed; b; )
+  {
+      Square s = pop_lsb(&b);
+      if (st->pieceAttacks[s] & changed)
+          update |= s;
+  }
+
+  while (update)
+  {
+      Square s = pop_lsb(&update);
+      st->pieceAttacks[s] = compute_piece_attacks(s);
+  }
+}
+
+#endif
+
+
 /// Position::attackers_to() computes a bitboard of all pieces which attack a
 /// given square. Slider attacks use the occupied bitboard to indicate occupancy.
 
@@ -675,7 +727,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   assert(is_ok(m));
   assert(&newSt != st);
 
-  thisThread->nodes.fetch_add(1, std::memory_order_relaxed);
+  if (!(++thisThread->nodes & 1023))
+      thisThread->publish_nodes();
+
   Key k = st->key ^ Zobrist::side;
 
   // Copy some fields of the old state to our new StateInfo object except the
@@ -685,6 +739,10 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   newSt.previous = st;
   st = &newSt;
 
+#ifdef INCREMENTAL_ATTACKS
+  Bitboard occupied = pieces(), castlingSquares = 0;
+#endif
+
   // Increment ply counters. In particular, rule50 will be reset to zero later on
   // in case of a capture or a pawn move.
   ++gamePly;
@@ -710,6 +768,11 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
       Square rfrom, rto;
       do_castling<true>(us, from, to, rfrom, rto);
 
+#ifdef INCREMENTAL_ATTACKS
+      // In Chess960 the occupancy may not change at all
+      castlingSquares = square_bb(rfrom) | rto;
+#endif
+
       k ^= Zobrist::psq[captured][rfrom] ^ Zobrist::psq[captured][rto];
       captured = NO_PIECE;
   }
@@ -813,6 +876,11 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
       st->rule50 = 0;
   }
 
+#ifdef INCREMENTAL_ATTACKS
+  // After castling, 'to' is the destination of the king
+  update_piece_attacks((occupied ^ pieces()) | castlingSquares | to);
+#endif
+
   // Set capture piece
   st->capturedPiece = captured;
 
@@ -952,7 +1020,7 @@ void Position::do_null_move(StateInfo& newSt) {
   }
 
   st->key ^= Zobrist::side;
-  prefetch(TT.first_entry(st->key));
+  prefetch(thisThread->engine->tt.first_entry(st->key));
 
   ++st->rule50;
   st->pliesFromNull = 0;
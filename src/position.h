@@ -44,6 +44,9 @@ struct StateInfo {
   int    rule50;
   int    pliesFromNull;
   Square epSquare;
+#ifdef INCREMENTAL_ATTACKS
+  Bitboard pieceAttacks[SQUARE_NB]; // See Position::piece_attacks()
+#endif
 
   // Not copied when making a move (will be recomputed anyhow)
   Key        key;
@@ -114,6 +117,9 @@ public:
   Bitboard attackers_to(Square s) const;
   Bitboard attackers_to(Square s, Bitboard occupied) const;
   Bitboard slider_blockers(Bitboard sliders, Square s, Bitboard& pinners) const;
+#ifdef INCREMENTAL_ATTACKS
+  Bitboard piece_attacks(Square s) const;
+#endif
 
   // Properties of moves
   bool legal(Move m) const;
@@ -168,6 +174,10 @@ private:
   void set_castling_right(Color c, Square rfrom);
   void set_state(StateInfo* si) const;
   void set_check_info(StateInfo* si) const;
+#ifdef INCREMENTAL_ATTACKS
+  Bitboard compute_piece_attacks(Square s) const;
+  void update_piece_attacks(Bitboard changed);
+#endif
 
   // Other helpers
   void put_piece(Piece pc, Square s);
@@ -286,6 +296,13 @@ inline Bitboard Position::attackers_to(Square s) const {
   return attackers_to(s, pieces());
 }
 
+#ifdef INCREMENTAL_ATTACKS
+inline Bitboard Position::piece_attacks(Square s) const {
+  assert(piece_on(s) != NO_PIECE && type_of(piece_on(s)) >= KNIGHT && type_of(piece_on(s)) <= QUEEN);
+  return st->pieceAttacks[s];
+}
+#endif
+
 inline Bitboard Position::checkers() const {
   return st->checkersBB;
 }
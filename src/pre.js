@@ -1,23 +1,468 @@
 (function () {
-  // Message listeners
+  // Engines
+  //
+  // The module itself is the default engine. createEngine() returns an
+  // object with the same messaging API for an additional, independent engine
+  // in the same module (see engine.h). Commands and output lines of engines
+  // other than the default one are prefixed by '@<id> '.
 
   var quit = false;
-  var listeners = [];
+  var engines = {};
+
+  // Worker pool
+  //
+  // Starting a worker takes a while, and a thread can not run before its
+  // worker has started. So workers are created and loaded with the module,
+  // and threads are attached to idle workers from the pool. One worker runs
+  // the command reader (see channel.cpp), the others search threads. Pass
+  // pthreadPoolSize to the module factory to override the default of one
+  // search thread per core. Threads beyond the pool still work, but start
+  // slower.
+
+  if (!Module['pthreadPoolSize']) {
+    var cores = typeof navigator !== 'undefined' && navigator['hardwareConcurrency']
+             || typeof process === 'object' && typeof require === 'function' && require('os').cpus().length
+             || 1;
+    Module['pthreadPoolSize'] = 1 + Math.min(Math.max(cores, 1), 32); // Threads: 1 to 32
+  }
+
+  // Memory reservation
+  //
+  // Growing the shared wasm memory is slow, because every worker has to
+  // update its view of the heap, and it can fail late. Pass reserveHash (in
+  // MB) to the module factory to start with enough memory for a hash table of
+  // that size, the threads of the worker pool and the largest eval cache. The
+  // default engine keeps the memory of the hash table for later changes of
+  // Hash up to that size (see TranspositionTable::reserve()). The size is
+  // limited to the maximum of Hash, and the memory to MAXIMUM_MEMORY, beyond
+  // which loading fails.
+  // The memory64 build has its own MAXIMUM_MEMORY, see memory64.js.
+
+  var INITIAL_MEMORY = 71303168; // See Makefile
+  var MAXIMUM_MEMORY = typeof MEMORY64_MAXIMUM_MEMORY === 'number' ? MEMORY64_MAXIMUM_MEMORY : 2147483648;
+  var MAX_HASH = MAXIMUM_MEMORY > 2147483648 ? MAXIMUM_MEMORY / (1024 * 1024) - 1024 : 1024; // MaxHashMB in ucioption.cpp
+  var THREAD_MEMORY = 24 * 1024 * 1024; // Thread, pawn and material tables, stack
+  var EVAL_CACHE_MEMORY = 256 * 1024 * 1024; // Maximum of Eval Cache, for all threads
+
+  if (Module['reserveHash']) {
+    Module['reserveHash'] = Math.min(Math.max(Module['reserveHash'] | 0, 0), MAX_HASH);
+    var reserved = INITIAL_MEMORY + Module['reserveHash'] * 1024 * 1024
+                 + Math.max(Module['pthreadPoolSize'] - 2, 0) * THREAD_MEMORY
+                 + EVAL_CACHE_MEMORY;
+    Module['INITIAL_MEMORY'] = Math.min(Math.ceil(reserved / 65536) * 65536, MAXIMUM_MEMORY); // In pages
+  }
+
+  // SIMD
+  //
+  // stockfish-simd.wasm is built from the same sources with SIMD128
+  // instructions (make ARCH=wasm-simd). It is loaded instead of
+  // stockfish.wasm where the tiny module below validates, i.e., where SIMD is
+  // supported. Pass simd: false to the module factory to always load
+  // stockfish.wasm.
+
+  var SIMD_PROBE = [0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11];
+
+  if (Module['simd'] !== false && typeof WebAssembly === 'object' && WebAssembly.validate(new Uint8Array(SIMD_PROBE))) {
+    var locateFile = Module['locateFile'];
+    Module['locateFile'] = function (path, prefix) {
+      if (path === 'stockfish.wasm') path = 'stockfish-simd.wasm';
+      return locateFile ? locateFile(path, prefix) : prefix + path;
+    };
+  }
+
+  function Listeners() {
+    this.messages = [];
+    this.progress = [];
+    this.requests = {};
+    this.batches = [];
+  }
+
+  function remove(list, listener) {
+    var idx = list.indexOf(listener);
+    if (idx >= 0) list.splice(idx, 1);
+  }
+
+  function bind(target, id) {
+    var listeners = engines[id] = new Listeners();
+
+    target['postMessage'] = function (command) {
+      if (!engines[id]) return;
+      queue.push(id ? '@' + id + ' ' + command : command);
+      if (id && command === 'quit') {
+        delete engines[id];
+        for (var request in listeners.requests)
+          listeners.requests[request].reject(new Error('Engine terminated'));
+        while (listeners.batches.length)
+          listeners.batches.shift().reject(new Error('Engine terminated'));
+      }
+      flush();
+    };
+
+    target['analyze'] = function (fen, options) {
+      return analyze(target, id, listeners, fen, options || {});
+    };
+
+    target['analyzeBatch'] = function (positions, options) {
+      return analyzeBatch(target, id, listeners, positions, options || {});
+    };
+
+    target['evaluateBatch'] = function (fens) {
+      return evaluateBatch(target, id, listeners, fens);
+    };
+
+    target['exportHash'] = function (options) {
+      return exportHash(target, id, listeners, options || {});
+    };
+
+    target['importHash'] = function (blob) {
+      return importHash(target, id, listeners, blob);
+    };
+
+    target['addMessageListener'] = function (listener) {
+      listeners.messages.push(listener);
+    };
+
+    target['removeMessageListener'] = function (listener) {
+      remove(listeners.messages, listener);
+    };
+
+    target['addProgressListener'] = function (listener) {
+      listeners.progress.push(listener);
+    };
+
+    target['removeProgressListener'] = function (listener) {
+      remove(listeners.progress, listener);
+    };
+
+    return target;
+  }
+
+  Module['createEngine'] = function () {
+    var engine = bind({}, Module['ccall']('engine_create', 'number', [], []));
+    engine['terminate'] = function () {
+      engine['postMessage']('quit');
+    };
+    return engine;
+  };
+
+  // Message listeners
+  //
+  // Lines printed in the same task (the engine writes held back info lines
+  // as one batch, see "Output Interval") are delivered together, from a
+  // single timeout.
+
+  var output = [];
+
+  function deliver() {
+    var lines = output;
+    output = [];
+    for (var i = 0; i < lines.length; i += 2) {
+      var listeners = lines[i].messages;
+      for (var j = 0; j < listeners.length; j++) listeners[j](lines[i + 1]);
+    }
+  }
 
   Module['print'] = function (line) {
-    if (listeners.length === 0) console.log(line);
-    else setTimeout(function () {
-      for (var i = 0; i < listeners.length; i++) listeners[i](line);
+    flush(); // The engine made progress, maybe there is room in the ring now
+
+    var id = 0;
+    if (line.charAt(0) === '@') {
+      var sep = line.indexOf(' ');
+      id = +line.slice(1, sep);
+      line = line.slice(sep + 1);
+    }
+
+    var listeners = engines[id];
+    if (!listeners) return; // Terminated
+    if (listeners.batches.length && line.lastIndexOf('batch ', 0) === 0) return batchLine(listeners, line);
+    if (listeners.messages.length === 0) console.log(line);
+    else if (output.push(listeners, line) === 2) setTimeout(deliver);
+  };
+
+  // Progress listeners
+  //
+  // With "setoption name Binary Info value true" the engine publishes PV
+  // lines as fixed layout records (see PvInfo in channel.h) instead of UCI
+  // info lines, and notifies us with the address of the buffer.
+
+  var PV_INFO_SIZE = 544; // sizeof(PvInfo)
+
+  // Addresses are divided rather than shifted into array indices, because
+  // they can exceed 31 bits in memory64 builds (ARCH=wasm64). There, the
+  // addresses and sizes we get from the engine may also be BigInt, so all of
+  // them pass through number() first. Numbers are exact up to 2^53.
+
+  function number(x) {
+    return Number(x);
+  }
+
+  function malloc(size) {
+    return number(Module['_malloc'](size));
+  }
+
+  function readPvInfo(ptr) {
+    var i32 = ptr / 4, i16 = ptr / 2;
+    var pvLength = HEAPU16[i16 + 23];
+    return {
+      'nodes': HEAPU32[i32] + HEAPU32[i32 + 1] * 4294967296,
+      'nps': HEAPU32[i32 + 2] + HEAPU32[i32 + 3] * 4294967296,
+      'time': HEAP32[i32 + 4],
+      'depth': HEAP32[i32 + 5],
+      'seldepth': HEAP32[i32 + 6],
+      'multipv': HEAP32[i32 + 7],
+      'score': HEAP32[i32 + 8],
+      'mate': HEAPU8[ptr + 36] !== 0,
+      'bound': HEAPU8[ptr + 37],
+      'hashfull': HEAP16[i16 + 19],
+      'wdl': [HEAP16[i16 + 20], HEAP16[i16 + 21], HEAP16[i16 + 22]],
+      'pv': HEAPU16.slice(i16 + 24, i16 + 24 + pvLength)
+    };
+  }
+
+  Module['onProgress'] = function (id, ptr) {
+    ptr = number(ptr);
+    var listeners = engines[id];
+    if (!listeners || listeners.progress.length === 0) return;
+
+    // Discard torn reads. The engine notifies again after each update.
+    var sequence = Atomics.load(HEAP32, ptr / 4);
+    if (sequence & 1) return;
+    var lines = [];
+    var count = HEAPU32[ptr / 4 + 1];
+    for (var i = 0; i < count; i++) lines.push(readPvInfo(ptr + 8 + i * PV_INFO_SIZE));
+    if (Atomics.load(HEAP32, ptr / 4) !== sequence) return;
+
+    for (var j = 0; j < listeners.progress.length; j++) listeners.progress[j](lines);
+  };
+
+  // Analyze requests
+  //
+  // analyze(fen, {depth, nodes, movetime, multipv, moves}) searches a position
+  // and resolves to {bestmove, ponder, lines}, with one entry per PV line in
+  // the format of the progress listeners, but with the moves as UCI strings.
+  // Progress listeners are called during the search as usual. The result is
+  // read from the same records, no info or bestmove lines are printed.
+
+  var nextRequest = 1;
+
+  function analyze(target, id, listeners, fen, options) {
+    return new Promise(function (resolve, reject) {
+      var request = nextRequest++;
+      var command = 'analyze ' + request;
+      var limits = ['depth', 'nodes', 'movetime', 'multipv'];
+      for (var i = 0; i < limits.length; i++)
+        if (options[limits[i]]) command += ' ' + limits[i] + ' ' + Math.floor(options[limits[i]]); // 64 bit nodes
+      command += !fen || fen === 'startpos' ? ' startpos' : ' fen ' + fen;
+      if (options['moves'] && options['moves'].length) command += ' moves ' + options['moves'].join(' ');
+
+      if (engines[id] !== listeners) return reject(new Error('Engine terminated'));
+      listeners.requests[request] = { resolve: resolve, reject: reject };
+      target['postMessage'](command);
+    });
+  }
+
+  var FILES = 'abcdefgh';
+
+  function square(s) {
+    return FILES.charAt(s & 7) + ((s >> 3) + 1);
+  }
+
+  // See UCI::move()
+  function moveToUci(m, chess960) {
+    if (m === 0 || m === 65) return null; // MOVE_NONE, MOVE_NULL
+    var from = (m >> 6) & 63, to = m & 63, type = m >> 14;
+    if (type === 3 && !chess960) to = (to > from ? 6 : 2) + (from & 56); // Castling
+    var uci = square(from) + square(to);
+    return type === 1 ? uci + 'nbrq'.charAt((m >> 12) & 3) : uci;
+  }
+
+  Module['onResult'] = function (id, request, best, ponder, chess960, ptr) {
+    ptr = number(ptr);
+    var listeners = engines[id];
+    var pending = listeners && listeners.requests[request];
+    if (!pending) return;
+    delete listeners.requests[request];
+
+    // The search is over, so the records are stable
+    var lines = [];
+    var count = HEAPU32[ptr / 4 + 1];
+    for (var i = 0; i < count; i++) {
+      var info = readPvInfo(ptr + 8 + i * PV_INFO_SIZE);
+      var pv = [];
+      for (var j = 0; j < info['pv'].length; j++) pv.push(moveToUci(info['pv'][j], chess960));
+      info['pv'] = pv;
+      lines.push(info);
+    }
+
+    pending.resolve({
+      'bestmove': moveToUci(best, chess960),
+      'ponder': moveToUci(ponder, chess960),
+      'lines': lines
     });
   };
 
-  Module['addMessageListener'] = function (listener) {
-    listeners.push(listener);
+  // Batch analysis
+  //
+  // analyzeBatch(positions, {depth, nodes}) searches many positions at once,
+  // each one by a single thread (see Thread::search_batch()). A position is a
+  // FEN, 'startpos' or {fen, moves}. Resolves to one result per position, null
+  // for an invalid one:
+  // {depth, seldepth, score, mate, nodes, pv}, with the moves as UCI strings.
+  // The engine answers batches in order, so the pending ones are a queue.
+
+  function analyzeBatch(target, id, listeners, positions, options) {
+    return new Promise(function (resolve, reject) {
+      var command = 'batch';
+      if (options['depth']) command += ' depth ' + (options['depth'] | 0);
+      if (options['nodes']) command += ' nodes ' + Math.floor(options['nodes']);
+      for (var i = 0; i < positions.length; i++) {
+        var p = typeof positions[i] === 'string' ? { 'fen': positions[i] } : positions[i];
+        command += !p['fen'] || p['fen'] === 'startpos' ? ' position startpos' : ' position fen ' + p['fen'];
+        if (p['moves'] && p['moves'].length) command += ' moves ' + p['moves'].join(' ');
+      }
+
+      if (engines[id] !== listeners) return reject(new Error('Engine terminated'));
+      if (!positions.length) return resolve([]);
+      listeners.batches.push({ resolve: resolve, reject: reject, results: [] });
+      target['postMessage'](command);
+    });
+  }
+
+  // batch <n> depth <d> seldepth <d> [score cp|mate <x>] nodes <n> [pv ...]
+  // batch <n> error
+  // batch done nodes <n> nps <n> time <ms>
+  // batch error busy
+  function batchLine(listeners, line) {
+    var batch = listeners.batches[0];
+    var tokens = line.split(' ');
+    if (tokens[1] === 'done') return batch.resolve(listeners.batches.shift().results);
+    if (tokens[1] === 'error') return listeners.batches.shift().reject(new Error('Not available during a search'));
+
+    if (tokens[2] === 'error') { // Invalid position
+      batch.results[+tokens[1] - 1] = null;
+      return;
+    }
+    var result = { 'score': null, 'mate': false, 'pv': [] };
+    for (var i = 2; i < tokens.length; i++) {
+      var token = tokens[i];
+      if (token === 'pv') { result['pv'] = tokens.slice(i + 1); break; }
+      if (token === 'score') {
+        result['mate'] = tokens[++i] === 'mate';
+        result['score'] = +tokens[++i];
+      }
+      else result[token] = +tokens[++i];
+    }
+    batch.results[+tokens[1] - 1] = result;
+  }
+
+  // Batch evaluation
+  //
+  // evaluateBatch(fens) resolves to an Int16Array with the static evaluation
+  // of each position, computed in parallel by the engine's threads (see
+  // Eval::evaluate_batch()). Values are in internal units (208 per pawn in
+  // the endgame) from the side to move's point of view, or 32002 for
+  // positions in check. The FENs and the results are passed through the heap.
+
+  function evaluateBatch(target, id, listeners, fens) {
+    return new Promise(function (resolve, reject) {
+      if (engines[id] !== listeners) return reject(new Error('Engine terminated'));
+
+      var request = nextRequest++;
+      var text = fens.join('\n') + '\n';
+      var input = malloc(text.length);
+      var output = malloc(2 * fens.length || 2);
+      if (!input || !output) {
+        Module['_free'](input); // free(0) is a no-op
+        Module['_free'](output);
+        return reject(new Error('Out of memory'));
+      }
+      for (var i = 0; i < text.length; i++) HEAPU8[input + i] = text.charCodeAt(i) & 127;
+
+      listeners.requests[request] = {
+        resolve: function () {
+          var results = HEAP16.slice(output / 2, output / 2 + fens.length);
+          Module['_free'](input);
+          Module['_free'](output);
+          resolve(results);
+        },
+        reject: reject, // The engine may still write, so the buffers are not freed
+        cancel: function () { // Not run at all
+          Module['_free'](input);
+          Module['_free'](output);
+        }
+      };
+      target['postMessage'](['evalbatch', request, input, fens.length, output].join(' '));
+    });
+  }
+
+  // Hash snapshots
+  //
+  // exportHash({minDepth, maxAge}) resolves to a Uint8Array with the entries
+  // of the transposition table of at least minDepth, from the current or the
+  // last maxAge searches (see TranspositionTable::serialize()). importHash()
+  // merges such a snapshot back into a table, of any size, to warm up later
+  // searches, for instance after a reload. Both are rejected during a search,
+  // like evaluateBatch(), analyze() and analyzeBatch().
+
+  function exportHash(target, id, listeners, options) {
+    return new Promise(function (resolve, reject) {
+      if (engines[id] !== listeners) return reject(new Error('Engine terminated'));
+
+      var request = nextRequest++;
+      var minDepth = options['minDepth'] === undefined ? -7 : options['minDepth'] | 0;
+      var maxAge = options['maxAge'] === undefined ? 32 : options['maxAge'] | 0;
+
+      listeners.requests[request] = {
+        resolve: function (ptr, size) {
+          if (!ptr) return reject(new Error('Out of memory'));
+          var blob = HEAPU8.slice(ptr, ptr + size);
+          Module['_free'](ptr);
+          resolve(blob);
+        },
+        reject: reject
+      };
+      target['postMessage'](['hashexport', request, minDepth, maxAge].join(' '));
+    });
+  }
+
+  function importHash(target, id, listeners, blob) {
+    return new Promise(function (resolve, reject) {
+      if (engines[id] !== listeners) return reject(new Error('Engine terminated'));
+
+      var request = nextRequest++;
+      var ptr = malloc(blob.length || 1);
+      if (!ptr) return reject(new Error('Out of memory'));
+      HEAPU8.set(blob, ptr);
+
+      listeners.requests[request] = {
+        resolve: function (unused, ok) {
+          Module['_free'](ptr);
+          ok ? resolve() : reject(new Error('Invalid hash snapshot'));
+        },
+        reject: reject, // The engine may still read, so the buffer is not freed
+        cancel: function () { Module['_free'](ptr); } // Not run at all
+      };
+      target['postMessage'](['hashimport', request, ptr, blob.length].join(' '));
+    });
+  }
+
+  // Completion of the requests that exchange data through the heap
+  Module['onComplete'] = function (id, request, ptr, size) {
+    var listeners = engines[id];
+    var pending = listeners && listeners.requests[request];
+    if (!pending) return;
+    delete listeners.requests[request];
+    pending.resolve(number(ptr), number(size));
   };
 
-  Module['removeMessageListener'] = function (listener) {
-    var idx = listeners.indexOf(listener);
-    if (idx >= 0) listeners.splice(idx, 1);
+  // Requests that the engine did not run, because it was searching
+  Module['onReject'] = function (id, request) {
+    var listeners = engines[id];
+    var pending = listeners && listeners.requests[request];
+    if (!pending) return;
+    delete listeners.requests[request];
+    if (pending.cancel) pending.cancel();
+    pending.reject(new Error('Not available during a search'));
   };
 
   Module['terminate'] = function () {
@@ -26,31 +471,62 @@
   };
 
   // Command queue
+  //
+  // Commands are copied into a ring buffer in the shared heap (see
+  // channel.h) and picked up by an engine thread that is blocked on a futex,
+  // so there is no polling. The queue only holds commands posted before the
+  // runtime is ready, or that do not fit into the ring at the moment. The
+  // main thread can not block until the reader frees space, so a full ring
+  // is retried from a timeout. Commands longer than the ring, like a batch of
+  // a long game, are written in parts, which the reader joins up to the
+  // newline.
+
+  var RING_SIZE = 65536; // CommandRing::Size
+  var RETRY_INTERVAL = 4; // ms
 
   var queue = [];
-  var backoff = 1;
+  var written = 0; // Characters of queue[0] already in the ring
+  var ring = 0;
+  var retry = 0;
 
-  function poll() {
-    var command = queue.shift();
-    if (quit || command === undefined) return;
+  // Copies as much of the command from offset start into the ring as fits,
+  // and returns the new offset, which is command.length + 1 once the newline
+  // is written too.
+  function push(command, start) {
+    var head = Atomics.load(HEAP32, ring / 4);
+    var tail = Atomics.load(HEAP32, ring / 4 + 1);
+    var end = Math.min(command.length + 1, start + RING_SIZE - ((head - tail) >>> 0));
+    if (end === start) return start;
 
-    if (command === 'quit') return Module['terminate']();
+    var data = ring + 8;
+    for (var i = start; i < end; i++) {
+      var c = i < command.length ? command.charCodeAt(i) : 10; // '\n'
+      HEAPU8[data + ((head + i - start) & (RING_SIZE - 1))] = c < 128 ? c : 63; // '?'
+    }
 
-    var tryLater = Module['ccall']('uci_command', 'number', ['string'], [command]);
-    if (tryLater) queue.unshift(command);
-    backoff = tryLater ? (backoff * 2) : 1;
-    setTimeout(poll, backoff);
+    Atomics.store(HEAP32, ring / 4, (head + end - start) | 0);
+    Atomics.notify(HEAP32, ring / 4, 1);
+    return end;
   }
 
-  Module['postMessage'] = function (command) {
-    queue.push(command);
-  };
+  function flush() {
+    while (!quit && ring && queue.length) {
+      if (!written && queue[0] === 'quit') return Module['terminate']();
+      written = push(queue[0], written);
+      if (written <= queue[0].length) { // Ring full, retry when the reader made progress
+        if (!retry) retry = setTimeout(function () { retry = 0; flush(); }, RETRY_INTERVAL);
+        return;
+      }
+      written = 0;
+      queue.shift();
+    }
+  }
+
+  bind(Module, 0);
+  if (Module['reserveHash']) Module['postMessage']('reserve ' + Module['reserveHash']);
 
   Module['postRun'] = function () {
-    Module['postMessage'] = function (command) {
-      queue.push(command);
-      if (queue.length === 1) poll();
-    };
-    poll();
+    ring = number(Module['ccall']('uci_command_ring', 'number', [], []));
+    flush();
   };
 })();
@@ -25,6 +25,8 @@
 #include <iostream>
 #include <sstream>
 
+#include "channel.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
@@ -36,11 +38,6 @@
 #include "tt.h"
 #include "uci.h"
 
-namespace Search {
-
-  LimitsType Limits;
-}
-
 using std::string;
 using Eval::evaluate;
 using namespace Search;
@@ -59,11 +56,9 @@ namespace {
     return Value(227 * (d - improving));
   }
 
-  // Reductions lookup table, initialized at startup
-  int Reductions[MAX_MOVES]; // [depth or moveNumber]
-
-  Depth reduction(bool i, Depth d, int mn) {
-    int r = Reductions[d] * Reductions[mn];
+  // Reductions lookup table of the engine, see Search::init()
+  Depth reduction(const Engine* engine, bool i, Depth d, int mn) {
+    int r = engine->threads.reductions[d] * engine->threads.reductions[mn];
     return (r + 570) / 1024 + (!i && r > 1018);
   }
 
@@ -175,15 +170,29 @@ namespace {
     return nodes;
   }
 
+  // report_pv() sends the PV lines to the GUI, either as UCI info lines or,
+  // when the "Binary Info" option is set or for an analyze request, through
+  // the progress channel.
+  void report_pv(const Position& pos, Depth depth, Value alpha, Value beta) {
+
+    pos.this_thread()->publish_nodes(); // Report the main thread's exact count
+
+    if (search_limits().request || options()["Binary Info"])
+        Channel::publish_pv(pos, depth, alpha, beta);
+    else
+        sync_cout << UCI::pv(pos, depth, alpha, beta) << sync_endl;
+  }
+
 } // namespace
 
 
-/// Search::init() is called at startup to initialize various lookup tables
+/// Search::init() is called when the number of threads changes to initialize
+/// the thread number dependent lookup tables of the current engine
 
 void Search::init() {
 
   for (int i = 1; i < MAX_MOVES; ++i)
-      Reductions[i] = int((24.8 + std::log(Threads.size())) * std::log(i));
+      threads().reductions[i] = int((24.8 + std::log(threads().size())) * std::log(i));
 }
 
 
@@ -191,11 +200,11 @@ void Search::init() {
 
 void Search::clear() {
 
-  Threads.main()->wait_for_search_finished();
+  threads().main()->wait_for_search_finished();
 
-  Time.availableNodes = 0;
-  TT.clear();
-  Threads.clear();
+  time_manager().availableNodes = 0;
+  tt().clear();
+  threads().clear();
 }
 
 
@@ -207,29 +216,32 @@ void MainThread::search() {
   // (D) Initialize startTime on the same thread that will measure
   // Time.elapsed(), because even steady clocks are not properly synchronized
   // between WASM threads.
-  Search::Limits.startTime = now();
+  engine->limits.startTime = now();
 
-  if (Limits.perft)
+  if (engine->limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
+      nodes = perft<true>(rootPos, engine->limits.perft);
+      engine->threads.running = false;
       sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
       return;
   }
 
   Color us = rootPos.side_to_move();
-  Time.init(Limits, us, rootPos.game_ply());
-  TT.new_search();
+  engine->time.init(engine->limits, us, rootPos.game_ply());
+  engine->tt.new_search();
 
   if (rootMoves.empty())
   {
       rootMoves.emplace_back(MOVE_NONE);
-      sync_cout << "info depth 0 score "
-                << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
-                << sync_endl;
+
+      if (!engine->limits.request) // Reported with the result otherwise
+          sync_cout << "info depth 0 score "
+                    << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                    << sync_endl;
   }
   else
   {
-      Threads.start_searching(); // start non-main threads
+      engine->threads.start_searching(); // start non-main threads
       Thread::search();          // main thread start searching
   }
 
@@ -239,44 +251,162 @@ void MainThread::search() {
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
-  {} // Busy wait for a stop or a ponder reset
+  flush_output(true); // Do not hold back the last info lines while waiting
+
+  wait_for_stop();
 
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
-  Threads.stop = true;
+  engine->threads.stop = true;
 
   // Wait until all threads have finished
-  Threads.wait_for_search_finished();
+  engine->threads.wait_for_search_finished();
+  engine->threads.running = false; // Commands may wait for the rest, see UCI::execute()
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
+  if (engine->limits.npmsec)
+      engine->time.availableNodes += engine->limits.inc[us] - engine->threads.nodes_searched();
 
   Thread* bestThread = this;
 
-  if (   int(Options["MultiPV"]) == 1
-      && !Limits.depth
-      && !(Skill(Options["Skill Level"]).enabled() || int(Options["UCI_LimitStrength"]))
+  if (   engine->limits.multiPV == 1
+      && !engine->limits.depth
+      && !(Skill(engine->options["Skill Level"]).enabled() || int(engine->options["UCI_LimitStrength"]))
       && rootMoves[0].pv[0] != MOVE_NONE)
-      bestThread = Threads.get_best_thread();
+      bestThread = engine->threads.get_best_thread();
 
   bestPreviousScore = bestThread->rootMoves[0].score;
 
   // Send again PV info if we have a new best thread
   if (bestThread != this)
-      sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
+      report_pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE);
 
-  sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
+  RootMove& best = bestThread->rootMoves[0];
+  bool hasPonder = best.pv.size() > 1 || best.extract_ponder_from_tt(rootPos);
 
-  if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
-      std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
+  // An analyze request gets its result as a binary record instead of 'bestmove'
+  if (engine->limits.request)
+  {
+      Channel::publish_result(bestThread->rootPos, bestThread->completedDepth,
+                              hasPonder ? best.pv[1] : MOVE_NONE);
+      return;
+  }
+
+  sync_cout << "bestmove " << UCI::move(best.pv[0], rootPos.is_chess960());
+
+  if (hasPonder)
+      std::cout << " ponder " << UCI::move(best.pv[1], rootPos.is_chess960());
 
   std::cout << sync_endl;
 }
 
 
+/// Thread::search_batch() runs a batch analysis, started by the 'batch' command.
+/// Instead of all threads searching the same position, each thread takes the
+/// next unsearched position and searches it alone, until all positions are
+/// done. The transposition table is shared as usual, which helps when the
+/// positions are from the same game. The main thread also starts the helpers
+/// and prints the results, in the order of the positions.
+
+void Thread::search_batch() {
+
+  bool isMain = this == engine->threads.main();
+  size_t n;
+
+  if (isMain)
+  {
+      engine->limits.startTime = now(); // See MainThread::search()
+      engine->tt.new_search();
+      engine->threads.start_searching(); // start non-main threads
+  }
+
+  while (!engine->threads.stop && (n = engine->threads.nextBatchEntry++) < engine->threads.batch.size())
+  {
+      Search::BatchEntry& e = engine->threads.batch[n];
+
+      if (!e.states) // Invalid position, reported as such
+          continue;
+
+      // See ThreadPool::start_thinking()
+      StateInfo tmp = e.states->back();
+      rootPos.set(e.fen, e.chess960, &e.states->back(), this);
+      e.states->back() = tmp;
+
+      rootMoves.clear();
+      for (const auto& m : MoveList<LEGAL>(rootPos))
+          rootMoves.emplace_back(m);
+
+      nodes = publishedNodes = nmpMinPly = bestMoveChanges = 0;
+      rootDepth = completedDepth = 0;
+
+      if (rootMoves.empty())
+      {
+          e.depth = e.selDepth = 0;
+          e.score = rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW;
+          e.nodes = 0;
+          continue;
+      }
+
+      Thread::search(); // Not MainThread::search()
+
+      const RootMove& rm = rootMoves[0];
+      e.depth = completedDepth;
+      e.selDepth = rm.selDepth;
+      e.score = rm.score != -VALUE_INFINITE ? rm.score
+              : rm.previousScore != -VALUE_INFINITE ? rm.previousScore : VALUE_NONE;
+      e.nodes = nodes;
+      e.pv = rm.pv;
+  }
+
+  if (!isMain)
+      return;
+
+  engine->threads.wait_for_search_finished();
+  engine->threads.running = false;
+
+  // Positions not searched because of a 'stop' are reported without a score
+  uint64_t total = 0;
+  TimePoint elapsed = std::max(now() - engine->limits.startTime, TimePoint(1));
+
+  for (size_t i = 0; i < engine->threads.batch.size(); ++i)
+  {
+      const Search::BatchEntry& e = engine->threads.batch[i];
+      std::stringstream ss;
+
+      if (!e.states)
+      {
+          sync_cout << "batch " << i + 1 << " error" << sync_endl;
+          continue;
+      }
+
+      ss << "batch " << i + 1
+         << " depth "    << e.depth
+         << " seldepth " << e.selDepth;
+
+      if (e.score != VALUE_NONE)
+          ss << " score " << UCI::value(e.score);
+
+      ss << " nodes " << e.nodes;
+
+      if (!e.pv.empty())
+          ss << " pv";
+
+      for (Move m : e.pv)
+          ss << " " << UCI::move(m, e.chess960);
+
+      sync_cout << ss.str() << sync_endl;
+      total += e.nodes;
+  }
+
+  sync_cout << "batch done nodes " << total
+            << " nps " << total * 1000 / elapsed
+            << " time " << elapsed << sync_endl;
+
+  engine->threads.batch.clear();
+}
+
+
 /// Thread::search() is the main iterative deepening loop. It calls search()
 /// repeatedly with increasing depth until the allocated thinking time has been
 /// consumed, the user stops the search, or the maximum search depth is reached.
@@ -292,7 +422,8 @@ void Thread::search() {
   Value bestValue, alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  MainThread* mainThread = (this == engine->threads.main() && engine->threads.batch.empty() ? engine->threads.main() : nullptr);
+  bool inBatch = !engine->threads.batch.empty();
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
@@ -319,7 +450,7 @@ void Thread::search() {
   std::copy(&lowPlyHistory[2][0], &lowPlyHistory.back().back() + 1, &lowPlyHistory[0][0]);
   std::fill(&lowPlyHistory[MAX_LPH - 2][0], &lowPlyHistory.back().back() + 1, 0);
 
-  size_t multiPV = size_t(Options["MultiPV"]);
+  size_t multiPV = size_t(engine->limits.multiPV);
 
   // Pick integer skill levels, but non-deterministically round up or down
   // such that the average integer skill corresponds to the input floating point one.
@@ -327,9 +458,9 @@ void Thread::search() {
   // to CCRL Elo (goldfish 1.13 = 2000) and a fit through Ordo derived Elo
   // for match (TC 60+0.6) results spanning a wide range of k values.
   PRNG rng(now());
-  double floatLevel = Options["UCI_LimitStrength"] ?
-                      Utility::clamp(std::pow((Options["UCI_Elo"] - 1346.6) / 143.4, 1 / 0.806), 0.0, 20.0) :
-                        double(Options["Skill Level"]);
+  double floatLevel = engine->options["UCI_LimitStrength"] ?
+                      Utility::clamp(std::pow((engine->options["UCI_Elo"] - 1346.6) / 143.4, 1 / 0.806), 0.0, 20.0) :
+                        double(engine->options["Skill Level"]);
   int intLevel = int(floatLevel) +
                  ((floatLevel - int(floatLevel)) * 1024 > rng.rand<unsigned>() % 1024  ? 1 : 0);
   Skill skill(intLevel);
@@ -342,14 +473,14 @@ void Thread::search() {
   multiPV = std::min(multiPV, rootMoves.size());
   ttHitAverage = TtHitAverageWindow * TtHitAverageResolution / 2;
 
-  int ct = int(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
+  int ct = int(engine->options["Contempt"]) * PawnValueEg / 100; // From centipawns
 
   // In analysis mode, adjust contempt in accordance with user preference
-  if (Limits.infinite || Options["UCI_AnalyseMode"])
-      ct =  Options["Analysis Contempt"] == "Off"  ? 0
-          : Options["Analysis Contempt"] == "Both" ? ct
-          : Options["Analysis Contempt"] == "White" && us == BLACK ? -ct
-          : Options["Analysis Contempt"] == "Black" && us == WHITE ? -ct
+  if (engine->limits.infinite || engine->options["UCI_AnalyseMode"])
+      ct =  engine->options["Analysis Contempt"] == "Off"  ? 0
+          : engine->options["Analysis Contempt"] == "Both" ? ct
+          : engine->options["Analysis Contempt"] == "White" && us == BLACK ? -ct
+          : engine->options["Analysis Contempt"] == "Black" && us == WHITE ? -ct
           : ct;
 
   // Evaluation score is from the white point of view
@@ -360,8 +491,8 @@ void Thread::search() {
 
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !engine->threads.stop
+         && !(engine->limits.depth && (mainThread || inBatch) && rootDepth > engine->limits.depth))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -375,11 +506,11 @@ void Thread::search() {
       size_t pvFirst = 0;
       pvLast = 0;
 
-      if (!Threads.increaseDepth)
+      if (!engine->threads.increaseDepth)
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !engine->threads.stop; ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -425,7 +556,7 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (engine->threads.stop)
                   break;
 
               // When failing high/low give some update (without cluttering
@@ -433,8 +564,8 @@ void Thread::search() {
               if (   mainThread
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
-                  sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+                  && engine->time.elapsed() > 3000)
+                  report_pv(rootPos, rootDepth, alpha, beta);
 
               // In case of failing low/high increase aspiration window and
               // re-search, otherwise exit the loop.
@@ -467,23 +598,33 @@ void Thread::search() {
           std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
-              sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+              && (engine->threads.stop || pvIdx + 1 == multiPV || engine->time.elapsed() > 3000))
+              report_pv(rootPos, rootDepth, alpha, beta);
       }
 
-      if (!Threads.stop)
+      if (!engine->threads.stop)
           completedDepth = rootDepth;
 
+      publish_nodes();
+
       if (rootMoves[0].pv[0] != lastBestMove) {
          lastBestMove = rootMoves[0].pv[0];
          lastBestMoveDepth = rootDepth;
       }
 
       // Have we found a "mate in x"?
-      if (   Limits.mate
+      if (   engine->limits.mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
-          && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          && VALUE_MATE - bestValue <= 2 * engine->limits.mate)
+      {
+          engine->threads.stop = true;
+          engine->threads.main()->wake_up(); // Helpers may find it with main thread waiting
+      }
+
+      // In a batch analysis the nodes limit is per position, and checked
+      // only between iterations.
+      if (inBatch && engine->limits.nodes && nodes >= uint64_t(engine->limits.nodes))
+          break;
 
       if (!mainThread)
           continue;
@@ -493,8 +634,8 @@ void Thread::search() {
           skill.pick_best(multiPV);
 
       // Do we have time for the next iteration? Can we stop searching now?
-      if (    Limits.use_time_management()
-          && !Threads.stop
+      if (    engine->limits.use_time_management()
+          && !engine->threads.stop
           && !mainThread->stopOnPonderhit)
       {
           double fallingEval = (296 + 6 * (mainThread->bestPreviousScore - bestValue)
@@ -506,38 +647,40 @@ void Thread::search() {
           double reduction = (1.47 + mainThread->previousTimeReduction) / (2.22 * timeReduction);
 
           // Use part of the gained time from a previous stable move for the current move
-          for (Thread* th : Threads)
+          for (Thread* th : engine->threads)
           {
               totBestMoveChanges += th->bestMoveChanges;
               th->bestMoveChanges = 0;
           }
-          double bestMoveInstability = 1 + totBestMoveChanges / Threads.size();
+          double bestMoveInstability = 1 + totBestMoveChanges / engine->threads.size();
 
           double totalTime = rootMoves.size() == 1 ? 0 :
-                             Time.optimum() * fallingEval * reduction * bestMoveInstability;
+                             engine->time.optimum() * fallingEval * reduction * bestMoveInstability;
 
           // Stop the search if we have exceeded the totalTime, at least 1ms search
-          if (Time.elapsed() > totalTime)
+          if (engine->time.elapsed() > totalTime)
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
               if (mainThread->ponder)
                   mainThread->stopOnPonderhit = true;
               else
-                  Threads.stop = true;
+                  engine->threads.stop = true;
           }
-          else if (   Threads.increaseDepth
+          else if (   engine->threads.increaseDepth
                    && !mainThread->ponder
-                   && Time.elapsed() > totalTime * 0.56)
-                   Threads.increaseDepth = false;
+                   && engine->time.elapsed() > totalTime * 0.56)
+                   engine->threads.increaseDepth = false;
           else
-                   Threads.increaseDepth = true;
+                   engine->threads.increaseDepth = true;
       }
 
       mainThread->iterValue[iterIdx] = bestValue;
       iterIdx = (iterIdx + 1) & 3;
   }
 
+  publish_nodes(); // Exact count once the search is over
+
   if (!mainThread)
       return;
 
@@ -596,6 +739,7 @@ namespace {
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
+    Engine* engine = thisThread->engine;
     ss->inCheck = pos.checkers();
     priorCapture = pos.captured_piece();
     Color us = pos.side_to_move();
@@ -604,7 +748,7 @@ namespace {
     maxValue = VALUE_INFINITE;
 
     // Check for the available remaining time
-    if (thisThread == Threads.main())
+    if (thisThread == engine->threads.main())
         static_cast<MainThread*>(thisThread)->check_time();
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
@@ -614,7 +758,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   engine->threads.stop.load(std::memory_order_relaxed)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -654,13 +798,18 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ttHit);
+    tte = engine->tt.probe(posKey, ttHit);
     ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
             : ttHit    ? tte->move() : MOVE_NONE;
     ttPv = PvNode || (ttHit && tte->is_pv());
     formerPv = ttPv && !PvNode;
 
+#ifdef TT_STATS
+    if (ttHit)
+        TTStats::check(pos, tte);
+#endif
+
     if (   ttPv
         && depth > 12
         && ss->ply - 1 < MAX_LPH
@@ -743,7 +892,7 @@ namespace {
         else
             ss->staticEval = eval = -(ss-1)->staticEval + 2 * Tempo;
 
-        tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+        tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval, engine->tt.generation());
     }
 
     // Step 7. Razoring (~1 Elo)
@@ -871,7 +1020,7 @@ namespace {
                        && ttValue != VALUE_NONE))
                         tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
                             BOUND_LOWER,
-                            depth - 3, move, ss->staticEval);
+                            depth - 3, move, ss->staticEval, engine->tt.generation());
                     return value;
                 }
             }
@@ -882,7 +1031,7 @@ namespace {
     {
         search<NT>(pos, ss, alpha, beta, depth - 7, cutNode);
 
-        tte = TT.probe(posKey, ttHit);
+        tte = engine->tt.probe(posKey, ttHit);
         ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
         ttMove = ttHit ? tte->move() : MOVE_NONE;
     }
@@ -929,7 +1078,8 @@ moves_loop: // When in check, search starts from here
 
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+      if (   rootNode && thisThread == engine->threads.main() && engine->threads.batch.empty()
+          && !engine->limits.request && engine->time.elapsed() > 3000)
           sync_cout << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -953,7 +1103,7 @@ moves_loop: // When in check, search starts from here
           moveCountPruning = moveCount >= futility_move_count(improving, depth);
 
           // Reduced depth of the next LMR search
-          int lmrDepth = std::max(newDepth - reduction(improving, depth, moveCount), 0);
+          int lmrDepth = std::max(newDepth - reduction(engine, improving, depth, moveCount), 0);
 
           if (   !captureOrPromotion
               && !givesCheck)
@@ -1076,7 +1226,7 @@ moves_loop: // When in check, search starts from here
       newDepth += extension;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(engine->tt.first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (!rootNode && !pos.legal(move))
@@ -1106,7 +1256,7 @@ moves_loop: // When in check, search starts from here
               || cutNode
               || thisThread->ttHitAverage < 415 * TtHitAverageResolution * TtHitAverageWindow / 1024))
       {
-          Depth r = reduction(improving, depth, moveCount);
+          Depth r = reduction(engine, improving, depth, moveCount);
 
           // Decrease reduction at non-check cut nodes for second move at low depths
           if (   cutNode
@@ -1235,7 +1385,7 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (engine->threads.stop.load(std::memory_order_relaxed))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1304,7 +1454,7 @@ moves_loop: // When in check, search starts from here
     // completed. But in this case bestValue is valid because we have fully
     // searched our subtree, and we can anyhow save the result in TT.
     /*
-       if (Threads.stop)
+       if (engine->threads.stop)
         return VALUE_DRAW;
     */
 
@@ -1335,7 +1485,7 @@ moves_loop: // When in check, search starts from here
         tte->save(posKey, value_to_tt(bestValue, ss->ply), ttPv,
                   bestValue >= beta ? BOUND_LOWER :
                   PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+                  depth, bestMove, ss->staticEval, engine->tt.generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1372,6 +1522,7 @@ moves_loop: // When in check, search starts from here
     }
 
     Thread* thisThread = pos.this_thread();
+    Engine* engine = thisThread->engine;
     (ss+1)->ply = ss->ply + 1;
     bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
@@ -1391,11 +1542,16 @@ moves_loop: // When in check, search starts from here
                                                   : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey, ttHit);
+    tte = engine->tt.probe(posKey, ttHit);
     ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove = ttHit ? tte->move() : MOVE_NONE;
     pvHit = ttHit && tte->is_pv();
 
+#ifdef TT_STATS
+    if (ttHit)
+        TTStats::check(pos, tte);
+#endif
+
     if (  !PvNode
         && ttHit
         && tte->depth() >= ttDepth
@@ -1433,7 +1589,7 @@ moves_loop: // When in check, search starts from here
         {
             if (!ttHit)
                 tte->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
-                          DEPTH_NONE, MOVE_NONE, ss->staticEval);
+                          DEPTH_NONE, MOVE_NONE, ss->staticEval, engine->tt.generation());
 
             return bestValue;
         }
@@ -1495,7 +1651,7 @@ moves_loop: // When in check, search starts from here
           continue;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(engine->tt.first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (!pos.legal(move))
@@ -1545,7 +1701,7 @@ moves_loop: // When in check, search starts from here
     tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
               bestValue >= beta ? BOUND_LOWER :
               PvNode && bestValue > oldAlpha  ? BOUND_EXACT : BOUND_UPPER,
-              ttDepth, bestMove, ss->staticEval);
+              ttDepth, bestMove, ss->staticEval, engine->tt.generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1700,8 +1856,8 @@ moves_loop: // When in check, search starts from here
 
   Move Skill::pick_best(size_t multiPV) {
 
-    const RootMoves& rootMoves = Threads.main()->rootMoves;
-    static PRNG rng(now()); // PRNG sequence should be non-deterministic
+    const RootMoves& rootMoves = threads().main()->rootMoves;
+    static thread_local PRNG rng(now()); // Non-deterministic, and per engine as each has its own main thread
 
     // RootMoves are already sorted by score in descending order
     Value topScore = rootMoves[0].score;
@@ -1740,12 +1896,14 @@ void MainThread::check_time() {
       return;
 
   // When using nodes, ensure checking rate is not lower than 0.1% of nodes
-  callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
+  callsCnt = engine->limits.nodes ? std::min(1024, int(engine->limits.nodes / 1024)) : 1024;
 
-  static TimePoint lastInfoTime = now();
+  publish_nodes(); // Own count is exact, helpers lag by less than 1024 nodes
 
-  TimePoint elapsed = Time.elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
+  static thread_local TimePoint lastInfoTime = now(); // Per engine, see Skill::pick_best()
+
+  TimePoint elapsed = engine->time.elapsed();
+  TimePoint tick = engine->limits.startTime + elapsed;
 
   if (tick - lastInfoTime >= 1000)
   {
@@ -1753,14 +1911,20 @@ void MainThread::check_time() {
       dbg_print();
   }
 
+  flush_output(); // Release held back info lines if the output interval is up
+
+  // Limits of a batch analysis apply to each position, see Thread::search()
+  if (!engine->threads.batch.empty())
+      return;
+
   // We should not stop pondering until told so by the GUI
   if (ponder)
       return;
 
-  if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
-      Threads.stop = true;
+  if (   (engine->limits.use_time_management() && (elapsed > engine->time.maximum() - 10 || stopOnPonderhit))
+      || (engine->limits.movetime && elapsed >= engine->limits.movetime)
+      || (engine->limits.nodes && engine->threads.nodes_searched() >= (uint64_t)engine->limits.nodes))
+      engine->threads.stop = true;
 }
 
 
@@ -1770,11 +1934,11 @@ void MainThread::check_time() {
 string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
   std::stringstream ss;
-  long elapsed = std::max((long)Time.elapsed(), 1L); // Avoid divide by zero
+  long elapsed = std::max((long)time_manager().elapsed(), 1L); // Avoid divide by zero
   const RootMoves& rootMoves = pos.this_thread()->rootMoves;
   size_t pvIdx = pos.this_thread()->pvIdx;
-  size_t multiPV = std::min((size_t)Options["MultiPV"], rootMoves.size());
-  uint64_t nodesSearched = Threads.nodes_searched();
+  size_t multiPV = std::min((size_t)search_limits().multiPV, rootMoves.size());
+  uint64_t nodesSearched = threads().nodes_searched();
 
   for (size_t i = 0; i < multiPV; ++i)
   {
@@ -1795,7 +1959,7 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
          << " multipv "  << i + 1
          << " score "    << UCI::value(v);
 
-      if (Options["UCI_ShowWDL"])
+      if (options()["UCI_ShowWDL"])
           ss << UCI::wdl(v, pos.game_ply());
 
       if (i == pvIdx)
@@ -1805,7 +1969,7 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
          << " nps "      << nodesSearched * 1000 / elapsed;
 
       if (elapsed > 1000) // Earlier makes little sense
-          ss << " hashfull " << TT.hashfull();
+          ss << " hashfull " << tt().hashfull();
 
       ss << " time "     << elapsed
          << " pv";
@@ -1834,7 +1998,7 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry* tte = tt().probe(pos.key(), ttHit);
 
     if (ttHit)
     {
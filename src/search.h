@@ -21,6 +21,7 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <string>
 #include <vector>
 
 #include "misc.h"
@@ -84,7 +85,7 @@ struct LimitsType {
 
   LimitsType() { // Init explicitly due to broken value-initialization of non POD in MSVC
     time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = TimePoint(0);
-    movestogo = depth = mate = perft = infinite = 0;
+    movestogo = depth = mate = perft = infinite = multiPV = request = 0;
     nodes = 0;
   }
 
@@ -95,10 +96,30 @@ struct LimitsType {
   std::vector<Move> searchmoves;
   TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
   int movestogo, depth, mate, perft, infinite;
+  int multiPV; // Defaults to the MultiPV option
+  int request; // Id of an analyze request, 0 for 'go'
   int64_t nodes;
 };
 
-extern LimitsType Limits;
+
+/// BatchEntry is one position of a batch analysis, see Thread::search_batch(),
+/// and the result of its search once done. The states hold the move history
+/// of the position, so that repetitions are detected.
+
+struct BatchEntry {
+
+  std::string fen;
+  bool chess960;
+  StateListPtr states; // Null if the position arguments were invalid
+
+  Depth depth = 0;
+  int selDepth = 0;
+  Value score = VALUE_NONE; // Unless searched
+  uint64_t nodes = 0;
+  std::vector<Move> pv;
+};
+
+typedef std::vector<BatchEntry> Batch;
 
 void init();
 void clear();
@@ -21,19 +21,19 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include "engine.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
 #include "uci.h"
 #include "tt.h"
 
-ThreadPool Threads; // Global object
-
-
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
+/// The thread belongs to the engine it is created for.
 
-Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(size_t n) : idx(n), engine(CurrentEngine), stdThread(&Thread::idle_loop, this),
+                           pawnsTable(pawns_table().enabled() ? nullptr : new Pawns::Table) {
 
   // (A) Upstream does wait_for_search_finished() directly here.
   //
@@ -44,8 +44,9 @@ Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
   //
   // https://bugzilla.mozilla.org/show_bug.cgi?id=1049079
   //
-  // Instead we introduced threadStarted (B) and retry uci_command with
-  // exponential backoff until all threads have started.
+  // Instead we introduced threadStarted (B). Commands are executed on the
+  // command reader thread (see channel.cpp), which is allowed to block until
+  // all threads have started.
 }
 
 
@@ -81,6 +82,7 @@ void Thread::clear() {
   mainHistory.fill(0);
   lowPlyHistory.fill(0);
   captureHistory.fill(0);
+  evalCache.clear();
 
   for (bool inCheck : { false, true })
       for (StatsType c : { NoCaptures, Captures })
@@ -113,11 +115,40 @@ void Thread::wait_for_search_finished() {
 }
 
 
+/// MainThread::wait_for_stop() blocks the main thread at the end of a ponder
+/// or infinite search, until the search is stopped or a 'ponderhit' switches
+/// to normal search. Unlike spinning, this keeps the core (in the browser,
+/// the worker) idle meanwhile.
+
+void MainThread::wait_for_stop() {
+
+  std::unique_lock<std::mutex> lk(stopMutex);
+  stopCondition.wait(lk, [&]{ return threads().stop || !(ponder || search_limits().infinite); });
+}
+
+
+/// MainThread::wake_up() must be called after raising Threads.stop or resetting
+/// ponder while the main thread may be in wait_for_stop(). Taking the mutex
+/// makes sure that the wake up is not lost between check and wait.
+
+void MainThread::wake_up() {
+
+  std::lock_guard<std::mutex> lk(stopMutex);
+  stopCondition.notify_one();
+}
+
+
 /// Thread::idle_loop() is where the thread is parked, blocked on the
 /// condition variable, when it has no work to do.
 
 void Thread::idle_loop() {
 
+  CurrentEngine = engine;
+
+#ifdef TT_STATS
+  TTStats::current = &ttStats;
+#endif
+
   while (true)
   {
       std::unique_lock<std::mutex> lk(mutex);
@@ -132,7 +163,12 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
-      search();
+      if (threads().job)
+          (*threads().job)(*this);
+      else if (threads().batch.empty())
+          search();
+      else
+          search_batch();
   }
 }
 
@@ -161,6 +197,10 @@ void ThreadPool::set(size_t requested) {
           push_back(size() ? new Thread(size()) : new MainThread(0));
       clear();
 
+      // The eval cache is shared out anew, see set_eval_cache()
+      for (Thread* th : *this)
+          th->evalCache.resize(size_t(options()["Eval Cache"]) * 1024 * 1024 / size());
+
       // Init thread number dependent search params.
       Search::init();
   }
@@ -191,7 +231,10 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   main()->stopOnPonderhit = stop = false;
   increaseDepth = true;
   main()->ponder = ponderMode;
-  Search::Limits = limits;
+  search_limits() = limits;
+
+  if (!search_limits().multiPV)
+      search_limits().multiPV = int(options()["MultiPV"]);
   Search::RootMoves rootMoves;
 
   for (const auto& m : MoveList<LEGAL>(pos))
@@ -199,33 +242,96 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
           rootMoves.emplace_back(m);
 
+  // An analyze request brings its own position, which must not replace the
+  // one of the UCI 'position' command.
+  StateListPtr& rootStates = limits.request ? requestStates : setupStates;
+
   // After ownership transfer 'states' becomes empty, so if we stop the search
   // and call 'go' again without setting a new position states.get() == NULL.
-  assert(states.get() || setupStates.get());
+  assert(states.get() || rootStates.get());
 
   if (states.get())
-      setupStates = std::move(states); // Ownership transfer, states is now empty
+      rootStates = std::move(states); // Ownership transfer, states is now empty
 
   // We use Position::set() to set root position across threads. But there are
   // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
   // be deduced from a fen string, so set() clears them and to not lose the info
-  // we need to backup and later restore setupStates->back(). Note that setupStates
+  // we need to backup and later restore rootStates->back(). Note that rootStates
   // is shared by threads but is accessed in read-only mode.
-  StateInfo tmp = setupStates->back();
+  StateInfo tmp = rootStates->back();
 
   for (Thread* th : *this)
   {
-      th->nodes = th->nmpMinPly = th->bestMoveChanges = 0;
+      th->nodes = th->publishedNodes = th->nmpMinPly = th->bestMoveChanges = 0;
       th->rootDepth = th->completedDepth = 0;
       th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &setupStates->back(), th);
+      th->rootPos.set(pos.fen(), pos.is_chess960(), &rootStates->back(), th);
   }
 
-  setupStates->back() = tmp;
+  rootStates->back() = tmp;
+
+  running = true;
+  main()->start_searching();
+}
+
+/// ThreadPool::start_batch() starts a batch analysis of the given positions,
+/// see Thread::search_batch(), and returns immediately. The entries are moved
+/// into the pool for the duration of the analysis.
+
+void ThreadPool::start_batch(Search::Batch& entries, const Search::LimitsType& limits) {
+
+  main()->wait_for_search_finished();
+
+  main()->stopOnPonderhit = stop = false;
+  increaseDepth = true;
+  main()->ponder = false;
+  search_limits() = limits;
+  search_limits().multiPV = 1;
+
+  batch = std::move(entries);
+  nextBatchEntry = 0;
 
+  running = true;
   main()->start_searching();
 }
 
+/// ThreadPool::execute() runs the given function on all threads in parallel,
+/// in place of a search, and returns when it has finished on all of them.
+/// Threads that have not reached idle_loop() yet (B) would skip the job, for
+/// instance the zeroing of the first transposition table of a new engine, so
+/// we wait for them first, like UCI::execute() does.
+
+void ThreadPool::execute(const std::function<void(Thread&)>& f) {
+
+  for (Thread* th : *this)
+      if (!th->threadStarted)
+          th->wait_for_search_finished();
+
+  main()->wait_for_search_finished();
+
+  job = &f;
+
+  for (Thread* th : *this)
+      th->start_searching();
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
+
+  job = nullptr;
+}
+
+/// ThreadPool::set_eval_cache() shares the total size of the eval caches out
+/// among the threads, see Eval::Cache. The total is bounded by the "Eval Cache"
+/// option, so that the caches fit in the heap whatever the number of threads.
+
+void ThreadPool::set_eval_cache(size_t mbSize) {
+
+  main()->wait_for_search_finished();
+
+  for (Thread* th : *this)
+      th->evalCache.resize(mbSize * 1024 * 1024 / size());
+}
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
@@ -23,6 +23,8 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -32,13 +34,18 @@
 #include "pawns.h"
 #include "position.h"
 #include "search.h"
+#include "evaluate.h"
 #include "thread_win32_osx.h"
+#include "tt.h"
 
+struct Engine;
 
 /// Thread class keeps together all the thread-related stuff. We use
 /// per-thread pawn and material hash tables so that once we get a
 /// pointer to an entry its life time is unlimited and we don't have
-/// to care about someone changing the entry under our feet.
+/// to care about someone changing the entry under our feet. With a
+/// shared pawn table, see Pawns::SharedTable, the thread has no pawn
+/// table but a copy of the last entry it looked up.
 
 class Thread {
 
@@ -46,6 +53,11 @@ class Thread {
   std::condition_variable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
+
+public:
+  Engine* const engine; // Ditto, the engine the thread belongs to
+
+private:
   NativeThread stdThread;
 
 public:
@@ -54,18 +66,23 @@ public:
   virtual void search();
   void clear();
   void idle_loop();
+  void search_batch();
   void start_searching();
   void wait_for_search_finished();
   int best_move_count(Move move) const;
+  void publish_nodes() { publishedNodes.store(nodes, std::memory_order_relaxed); }
 
-  Pawns::Table pawnsTable;
+  std::unique_ptr<Pawns::Table> pawnsTable; // Null with a shared table
+  Pawns::Entry pawnsEntry = {};
+  Eval::Cache evalCache;
   Material::Table materialTable;
   size_t pvIdx, pvLast;
   uint64_t ttHitAverage;
   int selDepth, nmpMinPly;
   Color nmpColor;
   std::atomic_bool threadStarted;
-  std::atomic<uint64_t> nodes, bestMoveChanges;
+  uint64_t nodes; // Private to the thread, see publish_nodes()
+  std::atomic<uint64_t> publishedNodes, bestMoveChanges;
 
   Position rootPos;
   Search::RootMoves rootMoves;
@@ -76,6 +93,10 @@ public:
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory[2][2];
   Score contempt;
+
+#ifdef TT_STATS
+  TTStats ttStats = {};
+#endif
 };
 
 
@@ -87,6 +108,8 @@ struct MainThread : public Thread {
 
   void search() override;
   void check_time();
+  void wait_for_stop();
+  void wake_up();
 
   double previousTimeReduction;
   Value bestPreviousScore;
@@ -94,6 +117,10 @@ struct MainThread : public Thread {
   int callsCnt;
   bool stopOnPonderhit;
   std::atomic_bool ponder;
+
+private:
+  std::mutex stopMutex;
+  std::condition_variable stopCondition;
 };
 
 
@@ -104,19 +131,27 @@ struct MainThread : public Thread {
 struct ThreadPool : public std::vector<Thread*> {
 
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
+  void start_batch(Search::Batch&, const Search::LimitsType&);
+  void execute(const std::function<void(Thread&)>&);
+  void set_eval_cache(size_t);
   void clear();
   void set(size_t);
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
-  uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
+  uint64_t nodes_searched() const { return accumulate(&Thread::publishedNodes); }
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
 
   std::atomic_bool stop, increaseDepth;
+  std::atomic_bool running; // A search or batch has not reported its result yet
+  Search::Batch batch; // Empty unless a batch analysis is running
+  std::atomic<size_t> nextBatchEntry;
+  const std::function<void(Thread&)>* job = nullptr; // Run instead of a search, see execute()
+  int reductions[MAX_MOVES]; // [depth or moveNumber], see Search::init()
 
 private:
-  StateListPtr setupStates;
+  StateListPtr setupStates, requestStates; // Of the UCI position and of an analyze request
 
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
@@ -127,6 +162,4 @@ private:
   }
 };
 
-extern ThreadPool Threads;
-
 #endif // #ifndef THREAD_H_INCLUDED
@@ -66,6 +66,8 @@ public:
 
 #else // Default case: use STL classes
 
+static const size_t TH_STACK_SIZE = 0; // System default, for reference only
+
 typedef std::thread NativeThread;
 
 #endif
@@ -22,11 +22,18 @@
 #include <cfloat>
 #include <cmath>
 
+#include "engine.h"
 #include "search.h"
 #include "timeman.h"
 #include "uci.h"
 
-TimeManagement Time; // Our global time management object
+/// TimeManagement::elapsed() returns the time spent on the current search,
+/// in nodes when in 'nodes as time' mode.
+
+TimePoint TimeManagement::elapsed() const {
+
+  return search_limits().npmsec ? TimePoint(threads().nodes_searched()) : now() - startTime;
+}
 
 
 /// TimeManagement::init() is called at the beginning of the search and calculates
@@ -36,9 +43,9 @@ TimeManagement Time; // Our global time management object
 
 void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
 
-  TimePoint moveOverhead    = TimePoint(Options["Move Overhead"]);
-  TimePoint slowMover       = TimePoint(Options["Slow Mover"]);
-  TimePoint npmsec          = TimePoint(Options["nodestime"]);
+  TimePoint moveOverhead    = TimePoint(options()["Move Overhead"]);
+  TimePoint slowMover       = TimePoint(options()["Slow Mover"]);
+  TimePoint npmsec          = TimePoint(options()["nodestime"]);
 
   // opt_scale is a percentage of available time to use for the current move.
   // max_scale is a multiplier applied to optimumTime.
@@ -94,6 +101,6 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
   optimumTime = TimePoint(opt_scale * timeLeft);
   maximumTime = TimePoint(std::min(0.8 * limits.time[us] - moveOverhead, max_scale * optimumTime));
 
-  if (Options["Ponder"])
+  if (options()["Ponder"])
       optimumTime += optimumTime / 4;
 }
@@ -33,8 +33,7 @@ public:
   void init(Search::LimitsType& limits, Color us, int ply);
   TimePoint optimum() const { return optimumTime; }
   TimePoint maximum() const { return maximumTime; }
-  TimePoint elapsed() const { return Search::Limits.npmsec ?
-                                     TimePoint(Threads.nodes_searched()) : now() - startTime; }
+  TimePoint elapsed() const;
 
   int64_t availableNodes; // When in 'nodes as time' mode
 
@@ -44,6 +43,4 @@ private:
   TimePoint maximumTime;
 };
 
-extern TimeManagement Time;
-
 #endif // #ifndef TIMEMAN_H_INCLUDED
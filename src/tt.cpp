@@ -18,22 +18,40 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>   // For std::memset
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <thread>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "misc.h"
 #include "thread.h"
 #include "tt.h"
 #include "uci.h"
 
-TranspositionTable TT; // Our global transposition table
+#ifdef TT_STATS
+thread_local TTStats* TTStats::current;
+
+/// TTStats::check() counts a collision if the entry found for the position has
+/// a move that is not legal in it, as the entry belongs to another position.
+
+void TTStats::check(const Position& pos, const TTEntry* tte) {
+
+  if (tte->move() && !(pos.pseudo_legal(tte->move()) && pos.legal(tte->move())))
+      TT_STAT(collisions);
+}
+#endif
 
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
-/// overwriting an old position. Update is not atomic and can be racy.
+/// overwriting an old position, in the given generation of the table, see
+/// TranspositionTable::generation(). Update is not atomic and can be racy.
 
-void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
 
   // Preserve any existing move for the same position
   if (m || (uint16_t)k != key16)
@@ -49,42 +67,361 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
       key16     = (uint16_t)k;
       value16   = (int16_t)v;
       eval16    = (int16_t)ev;
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      genBound8 = (uint8_t)(generation8 | uint8_t(pv) << 2 | b);
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
+
+      TT_STAT(writes);
   }
+  else
+      TT_STAT(skippedWrites);
 }
 
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The content of the old table is carried over, see migrate(), unless there
+/// is not enough memory for both tables at once. Within a reservation, see
+/// reserve(), the table is resized in place without allocating.
 
 void TranspositionTable::resize(size_t mbSize) {
 
-  Threads.main()->wait_for_search_finished();
+  threads().main()->wait_for_search_finished();
+
+  size_t newClusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+
+  if (newClusterCount == clusterCount)
+      return;
+
+  if (newClusterCount <= reservedClusterCount)
+  {
+      migrate_in_place(newClusterCount);
+      return;
+  }
 
-  clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+  void* newMem = malloc(newClusterCount * sizeof(Cluster) + CacheLineSize - 1);
+
+  if (!newMem && mem) // Drop the old table and its content to make room
+  {
+      free(mem);
+      mem = nullptr;
+      newMem = malloc(newClusterCount * sizeof(Cluster) + CacheLineSize - 1);
+  }
 
-  mem = realloc(mem, clusterCount * sizeof(Cluster) + CacheLineSize - 1);
-  if (!mem)
+  if (!newMem)
   {
       std::cerr << "Failed to allocate " << mbSize
                 << "MB for transposition table." << std::endl;
       exit(EXIT_FAILURE);
   }
 
-  table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+  Cluster* newTable = (Cluster*)((uintptr_t(newMem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+  bool keep = mem != nullptr;
+
+  if (keep)
+      migrate(newTable, newClusterCount);
+
+  free(mem);
+  mem = newMem;
+  table = newTable;
+  clusterCount = newClusterCount;
+
+  if (reservedClusterCount) // Outgrown, the new table is the reservation
+      reservedClusterCount = newClusterCount;
+
+  if (!keep)
+      zero();
+}
+
+
+/// TranspositionTable::reserve() allocates the memory for a table of the given
+/// size in megabytes up front, and keeps it for later calls to resize() up to
+/// that size. This avoids growing the wasm memory, which is slow with threads
+/// and can fail in a fragmented heap, when the hash size changes. The current
+/// table is carried over into the reservation.
+
+void TranspositionTable::reserve(size_t mbSize) {
+
+  size_t current = clusterCount * sizeof(Cluster) / (1024 * 1024);
+
+  resize(std::max(mbSize, current));
+  reservedClusterCount = clusterCount;
+  resize(current);
+}
+
+
+/// TranspositionTable::migrate() fills the given new table with the entries of
+/// the current one, in parallel on the engine's threads. Entries only store 16
+/// bits of their key, so the exact new cluster of an entry is not known. Each
+/// new cluster takes the most valuable entries of the old clusters that cover
+/// the same key range. When shrinking by a whole factor, like between powers
+/// of two, that is exactly where the entries belong. Otherwise the old
+/// clusters at the boundaries of the range also hold entries of the
+/// neighbouring new clusters, and when growing, an entry is copied to all new
+/// clusters its old cluster splits into. Such copies are marked, see insert().
+
+void TranspositionTable::migrate(Cluster* newTable, size_t newClusterCount) const {
+
+  constexpr size_t ChunkSize = 1024 * 1024 / sizeof(Cluster);
+  std::atomic<size_t> next(0);
+
+  threads().execute([&](Thread&) {
+
+      for (size_t i; (i = next.fetch_add(ChunkSize)) < newClusterCount; )
+          for (size_t j = i; j < std::min(i + ChunkSize, newClusterCount); ++j)
+              migrate_cluster(newTable[j], j, newClusterCount);
+  });
+}
+
+
+/// TranspositionTable::migrate_in_place() is migrate() within the memory of
+/// the current table, for a reservation. A new cluster only takes entries from
+/// old clusters at the same or a higher index when shrinking, and at the same
+/// or a lower index when growing. So the clusters are filled in stages, in
+/// ascending order when shrinking and descending when growing, each cluster
+/// before its old content is overwritten. Within a stage no cluster reads an
+/// old cluster that another one overwrites, so the stage is filled in
+/// parallel, like in migrate(). Stages grow by the ratio of the sizes.
+
+void TranspositionTable::migrate_in_place(size_t newClusterCount) {
+
+  constexpr size_t ChunkSize = 1024 * 1024 / sizeof(Cluster);
+  bool grow = newClusterCount > clusterCount;
+  size_t lo = 0, hi = newClusterCount; // Clusters still to fill
+
+  auto fill = [&](size_t j) {
+      Cluster to;
+      migrate_cluster(to, j, newClusterCount);
+      table[j] = to;
+  };
+
+  while (lo < hi)
+  {
+      size_t begin = lo, end = hi;
+
+      // In 64 bits, because size_t is 32 bits on wasm, see migrate_cluster()
+      if (grow) // Stop above the last old cluster read by cluster hi - 1
+          begin = std::max(lo, std::min(hi - 1, size_t((uint64_t(hi) * clusterCount - 1) / newClusterCount) + 1));
+      else      // Stop at the first old cluster read by cluster lo
+          end = std::min(hi, std::max(lo + 1, size_t(uint64_t(lo) * clusterCount / newClusterCount)));
+
+      if (end - begin < ChunkSize)
+          for (size_t j = begin; j < end; ++j)
+              fill(j);
+      else
+      {
+          std::atomic<size_t> next(begin);
+
+          threads().execute([&](Thread&) {
+
+              for (size_t i; (i = next.fetch_add(ChunkSize)) < end; )
+                  for (size_t j = i; j < std::min(i + ChunkSize, end); ++j)
+                      fill(j);
+          });
+      }
+
+      if (grow)
+          hi = begin;
+      else
+          lo = end;
+  }
+
+  clusterCount = newClusterCount;
+}
+
+
+/// TranspositionTable::migrate_cluster() fills the given cluster with the
+/// entries of the old clusters overlapping the key range of the new cluster
+/// at the given index, see migrate().
+
+void TranspositionTable::migrate_cluster(Cluster& to, size_t idx, size_t newClusterCount) const {
+
+  std::memset(&to, 0, sizeof(Cluster));
+  to.epoch = epoch16;
+
+  // In 64 bits, because size_t is 32 bits on wasm
+  size_t first = size_t(uint64_t(idx) * clusterCount / newClusterCount);
+  size_t last  = size_t((uint64_t(idx + 1) * clusterCount - 1) / newClusterCount);
+
+  for (size_t k = first; k <= last; ++k)
+      if (table[k].epoch == epoch16)
+          for (const TTEntry& tte : table[k].entry)
+              if (tte.key16)
+                  insert(to, tte, newClusterCount > clusterCount);
+}
+
+
+/// TranspositionTable::insert() puts an entry into the given cluster, in place
+/// of an empty or the least valuable entry, as in probe(), if the new entry is
+/// more valuable. Entries that may have been copied to more than one cluster
+/// (as their key is not known) are marked as one search older: the copies in
+/// the wrong clusters are never found, so they should be the first to be
+/// replaced, while probe() refreshes the others.
+
+void TranspositionTable::insert(Cluster& cluster, const TTEntry& tte, bool copied) const {
+
+  auto worth = [&](const TTEntry& e) {
+      return e.depth8 - ((263 + generation8 - e.genBound8) & 0xF8);
+  };
+
+  TTEntry* replace = cluster.entry;
+
+  for (TTEntry& e : cluster.entry)
+      if (!e.key16 || worth(e) < worth(*replace))
+      {
+          replace = &e;
+          if (!e.key16)
+              break;
+      }
+
+  if (replace->key16 && worth(tte) <= worth(*replace))
+      return;
+
+  *replace = tte;
+
+  if (copied)
+      replace->genBound8 = uint8_t((generation8 - 8) | (tte.genBound8 & 0x7));
+}
+
+
+/// TranspositionTable::serialize() returns a snapshot of the table, to warm up
+/// a later search on the same positions with merge(). Only entries of at least
+/// the given depth, from the current or the last maxAge searches, are kept.
+/// All data is stored in the host byte order, which is little endian on wasm.
+///
+/// header   magic "SFTT", uint32 format version, uint64 cluster count,
+///          uint32 entry count, uint8 generation
+/// entries  uint32 cluster index, TTEntry (10 bytes)
+
+std::string TranspositionTable::serialize(Depth minDepth, int maxAge) const {
+
+  std::string blob("SFTT");
+  uint32_t version = 1, count = 0;
+  uint64_t clusters = clusterCount;
+
+  auto put = [&](const void* data, size_t size) { blob.append((const char*)data, size); };
+
+  put(&version, 4);
+  put(&clusters, 8);
+  put(&count, 4); // Patched below
+  put(&generation8, 1);
+
+  for (size_t i = 0; i < clusterCount; ++i)
+      if (table[i].epoch == epoch16)
+          for (const TTEntry& tte : table[i].entry)
+              if (   tte.key16
+                  && tte.depth() >= minDepth
+                  && ((generation8 - tte.genBound8) & 0xF8) <= 8 * maxAge)
+              {
+                  uint32_t idx = uint32_t(i);
+                  put(&idx, 4);
+                  put(&tte, sizeof(TTEntry));
+                  ++count;
+              }
+
+  blob.replace(16, 4, (const char*)&count, 4);
+  return blob;
+}
+
+
+/// TranspositionTable::merge() adds the entries of a snapshot taken by
+/// serialize() to the table, possibly of a different size, and returns false,
+/// leaving the table untouched, if the data is not a valid snapshot. Ages are
+/// kept relative to the current search. Entries replace less valuable ones,
+/// like in migrate().
+
+bool TranspositionTable::merge(const char* data, size_t size) {
+
+  constexpr size_t HeaderSize = 21, RecordSize = 4 + sizeof(TTEntry);
+  uint32_t version, count;
+  uint64_t clusters;
+  uint8_t gen;
+
+  if (size < HeaderSize || std::memcmp(data, "SFTT", 4))
+      return false;
+
+  std::memcpy(&version,  data + 4, 4);
+  std::memcpy(&clusters, data + 8, 8);
+  std::memcpy(&count,    data + 16, 4);
+  std::memcpy(&gen,      data + 20, 1);
+
+  if (version != 1 || !clusters || size != HeaderSize + uint64_t(count) * RecordSize)
+      return false;
+
+  // Check all records first, an invalid snapshot must leave the table as it is
+  for (const char* p = data + HeaderSize; p < data + size; p += RecordSize)
+  {
+      uint32_t idx;
+      TTEntry tte;
+
+      std::memcpy(&idx, p, 4);
+      std::memcpy(&tte, p + 4, sizeof(TTEntry));
+
+      if (idx >= clusters || !tte.key16)
+          return false;
+  }
+
+  threads().main()->wait_for_search_finished();
+
+  bool growing = clusterCount > clusters;
+
+  for (const char* p = data + HeaderSize; p < data + size; p += RecordSize)
+  {
+      uint32_t idx;
+      TTEntry tte;
+
+      std::memcpy(&idx, p, 4);
+      std::memcpy(&tte, p + 4, sizeof(TTEntry));
+
+      // Same age relative to our current search
+      tte.genBound8 = uint8_t((generation8 - ((gen - tte.genBound8) & 0xF8)) | (tte.genBound8 & 0x7));
+
+      size_t first = size_t(uint64_t(idx) * clusterCount / clusters);
+      size_t last  = size_t((uint64_t(idx + 1) * clusterCount - 1) / clusters);
+
+      for (size_t i = first; i <= last; ++i)
+      {
+          if (table[i].epoch != epoch16) // See probe()
+          {
+              std::memset(table[i].entry, 0, sizeof(table[i].entry));
+              table[i].epoch = epoch16;
+          }
+
+          insert(table[i], tte, growing);
+      }
+  }
 
-  clear();
+  return true;
 }
 
 
-/// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+/// TranspositionTable::clear() empties the transposition table in constant
+/// time, by starting a new epoch, see probe(). Only when the epoch counter
+/// wraps around, clusters from 65536 clears ago would look current again, so
+/// then the table is zeroed for real.
 
 void TranspositionTable::clear() {
 
-  std::memset(mem, 0, clusterCount * sizeof(Cluster) + CacheLineSize - 1);
+  if (++epoch16 == 0)
+      zero();
+}
+
+
+/// TranspositionTable::zero() initializes the entire transposition table to
+/// zero, in a multi-threaded way, and restarts the epoch count
+
+void TranspositionTable::zero() {
+
+  constexpr size_t ChunkSize = 1024 * 1024 / sizeof(Cluster);
+  std::atomic<size_t> next(0);
+
+  threads().execute([&](Thread&) {
+
+      for (size_t i; (i = next.fetch_add(ChunkSize)) < clusterCount; )
+          std::memset(&table[i], 0, std::min(ChunkSize, clusterCount - i) * sizeof(Cluster));
+  });
+
+  epoch16 = 0;
 }
 
 
@@ -97,16 +434,47 @@ void TranspositionTable::clear() {
 
 TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 
-  TTEntry* const tte = first_entry(key);
+  Cluster* const cluster = &table[mul_hi64(key, clusterCount)];
+  TTEntry* const tte = &cluster->entry[0];
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
 
-  for (int i = 0; i < ClusterSize; ++i)
-      if (!tte[i].key16 || tte[i].key16 == key16)
-      {
-          tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & 0x7)); // Refresh
+  TT_STAT(probes);
 
-          return found = (bool)tte[i].key16, &tte[i];
-      }
+  // A cluster not used since the last clear() is empty
+  if (cluster->epoch != epoch16)
+  {
+      std::memset(tte, 0, sizeof(cluster->entry));
+      cluster->epoch = epoch16;
+  }
+
+#ifdef USE_WASM_SIMD
+  // Compare all keys at once. In 16 bit lanes, the keys of the 10 byte entries
+  // are lanes 0 and 5 of the first half of the cluster and lane 2 of the second.
+  static_assert(ClusterSize == 3 && sizeof(TTEntry) == 10, "Unexpected Cluster layout");
+
+  const v128_t k = wasm_i16x8_splat(key16), zero = wasm_i16x8_splat(0);
+  const v128_t lo = wasm_v128_load(cluster);
+  const v128_t hi = wasm_v128_load(reinterpret_cast<const char*>(cluster) + 16);
+  int lanesLo = wasm_i16x8_bitmask(wasm_v128_or(wasm_i16x8_eq(lo, k), wasm_i16x8_eq(lo, zero)));
+  int lanesHi = wasm_i16x8_bitmask(wasm_v128_or(wasm_i16x8_eq(hi, k), wasm_i16x8_eq(hi, zero)));
+  int matches = (lanesLo & 1) | ((lanesLo >> 4) & 2) | (lanesHi & 4);
+  int hit = matches ? __builtin_ctz(matches) : ClusterSize;
+#else
+  int hit = 0;
+  while (hit < ClusterSize && tte[hit].key16 && tte[hit].key16 != key16)
+      ++hit;
+#endif
+
+  // The first empty entry or the one with our key
+  if (hit < ClusterSize)
+  {
+      tte[hit].genBound8 = uint8_t(generation8 | (tte[hit].genBound8 & 0x7)); // Refresh
+
+      if (tte[hit].key16)
+          TT_STAT(hits);
+
+      return found = (bool)tte[hit].key16, &tte[hit];
+  }
 
   // Find an entry to be replaced according to the replacement strategy
   TTEntry* replace = tte;
@@ -119,6 +487,13 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
           >   tte[i].depth8 - ((263 + generation8 -   tte[i].genBound8) & 0xF8))
           replace = &tte[i];
 
+#ifdef TT_STATS
+  if ((replace->genBound8 & 0xF8) != generation8)
+      TT_STAT(replacedOlder);
+  else
+      TT_STAT(replacedShallower);
+#endif
+
   return found = false, replace;
 }
 
@@ -131,7 +506,65 @@ int TranspositionTable::hashfull() const {
   int cnt = 0;
   for (int i = 0; i < 1000; ++i)
       for (int j = 0; j < ClusterSize; ++j)
-          cnt += (table[i].entry[j].genBound8 & 0xF8) == generation8;
+          cnt +=  table[i].epoch == epoch16
+              && (table[i].entry[j].genBound8 & 0xF8) == generation8;
 
   return cnt / ClusterSize;
 }
+
+
+/// TranspositionTable::stats() returns the transposition table events counted
+/// by the engine's threads since the last reset, summed over all threads, and
+/// optionally resets the counters.
+
+std::string TranspositionTable::stats(bool reset) {
+
+  std::stringstream ss;
+
+#ifdef TT_STATS
+
+  threads().main()->wait_for_search_finished();
+
+  TTStats sum = {};
+
+  for (Thread* th : threads())
+  {
+      const TTStats& st = th->ttStats;
+      sum.probes            += st.probes;
+      sum.hits              += st.hits;
+      sum.collisions        += st.collisions;
+      sum.replacedOlder     += st.replacedOlder;
+      sum.replacedShallower += st.replacedShallower;
+      sum.writes            += st.writes;
+      sum.skippedWrites     += st.skippedWrites;
+
+      if (reset)
+          th->ttStats = {};
+  }
+
+  auto rate = [](uint64_t n, uint64_t total) {
+      std::stringstream r;
+      r << std::fixed << std::setprecision(2) << (total ? 100.0 * n / total : 0.0) << "%";
+      return r.str();
+  };
+
+  uint64_t misses = sum.probes - sum.hits;
+
+  ss << "Probes             : " << sum.probes
+     << "\nHits               : " << sum.hits << " (" << rate(sum.hits, sum.probes) << ")"
+     << "\nCollisions         : " << sum.collisions << " (" << rate(sum.collisions, sum.hits) << " of hits)"
+     << "\nReplaced, older    : " << sum.replacedOlder << " (" << rate(sum.replacedOlder, misses) << " of misses)"
+     << "\nReplaced, shallower: " << sum.replacedShallower << " (" << rate(sum.replacedShallower, misses) << " of misses)"
+     << "\nWrites             : " << sum.writes
+     << "\nWrites skipped     : " << sum.skippedWrites << " (" << rate(sum.skippedWrites, sum.writes + sum.skippedWrites) << ")"
+     << "\nHashfull           : " << hashfull() << " permill";
+
+#else
+
+  (void)reset;
+  ss << "No statistics, build with 'make ttstats=yes'";
+
+#endif
+
+  return ss.str();
+}
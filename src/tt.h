@@ -21,6 +21,9 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <algorithm>
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
@@ -43,7 +46,7 @@ struct TTEntry {
   Depth depth() const { return (Depth)depth8 + DEPTH_OFFSET; }
   bool is_pv()  const { return (bool)(genBound8 & 0x4); }
   Bound bound() const { return (Bound)(genBound8 & 0x3); }
-  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
 
 private:
   friend class TranspositionTable;
@@ -57,11 +60,41 @@ private:
 };
 
 
+#ifdef TT_STATS
+
+/// TTStats counts the transposition table events of a search thread, see the
+/// 'ttstats' command. Counting is compiled in only with 'make ttstats=yes'.
+/// A collision is a hit on an entry of another position, found because its
+/// move is not legal in the probed one, so the count is a lower bound.
+
+class Position;
+
+struct TTStats {
+  uint64_t probes, hits, collisions, replacedOlder, replacedShallower, writes, skippedWrites;
+
+  static thread_local TTStats* current; // Of the calling thread, if any
+
+  static void check(const Position& pos, const TTEntry* tte);
+};
+
+#define TT_STAT(counter) (TTStats::current && ++TTStats::current->counter)
+
+#else
+
+#define TT_STAT(counter) (void)0
+
+#endif
+
+
 /// A TranspositionTable is an array of Cluster, of size clusterCount. Each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
 /// contains information on exactly one position. The size of a Cluster should
 /// divide the size of a cache line for best performance, as the cacheline is
 /// prefetched when possible.
+///
+/// Each cluster also records the epoch, counting calls to clear(), in which it
+/// was last used. Clusters from an older epoch are considered empty, so that
+/// clearing the table does not need to touch it.
 
 class TranspositionTable {
 
@@ -70,7 +103,7 @@ class TranspositionTable {
 
   struct Cluster {
     TTEntry entry[ClusterSize];
-    char padding[2]; // Pad to 32 bytes
+    uint16_t epoch; // Pads to 32 bytes
   };
 
   static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
@@ -78,24 +111,34 @@ class TranspositionTable {
 public:
  ~TranspositionTable() { free(mem); }
   void new_search() { generation8 += 8; } // Lower 3 bits are used by PV flag and Bound
+  uint8_t generation() const { return generation8; }
   TTEntry* probe(const Key key, bool& found) const;
   int hashfull() const;
+  size_t memory() const { return std::max(clusterCount, reservedClusterCount) * sizeof(Cluster); }
   void resize(size_t mbSize);
+  void reserve(size_t mbSize);
   void clear();
+  std::string serialize(Depth minDepth, int maxAge) const;
+  bool merge(const char* data, size_t size);
+  std::string stats(bool reset);
 
   TTEntry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
   }
 
 private:
-  friend struct TTEntry;
+  void zero();
+  void migrate(Cluster* newTable, size_t newClusterCount) const;
+  void migrate_in_place(size_t newClusterCount);
+  void migrate_cluster(Cluster& to, size_t idx, size_t newClusterCount) const;
+  void insert(Cluster& cluster, const TTEntry& tte, bool copied) const;
 
   size_t clusterCount;
+  size_t reservedClusterCount; // Capacity of mem after reserve(), otherwise 0
   Cluster* table;
   void* mem;
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  uint16_t epoch16;    // Size must be not bigger than Cluster::epoch
 };
 
-extern TranspositionTable TT;
-
 #endif // #ifndef TT_H_INCLUDED
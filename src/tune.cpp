@@ -22,6 +22,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "engine.h"
 #include "types.h"
 #include "misc.h"
 #include "uci.h"
@@ -67,8 +68,8 @@ static void make_option(const string& n, int v, const SetRange& r) {
   if (TuneResults.count(n))
       v = TuneResults[n];
 
-  Options[n] << UCI::Option(v, r(v).first, r(v).second, on_tune);
-  LastOption = &Options[n];
+  options()[n] << UCI::Option(v, r(v).first, r(v).second, on_tune);
+  LastOption = &options()[n];
 
   // Print formatted parameters, ready to be copy-pasted in Fishtest
   std::cout << n << ","
@@ -82,15 +83,15 @@ static void make_option(const string& n, int v, const SetRange& r) {
 template<> void Tune::Entry<int>::init_option() { make_option(name, value, range); }
 
 template<> void Tune::Entry<int>::read_option() {
-  if (Options.count(name))
-      value = int(Options[name]);
+  if (options().count(name))
+      value = int(options()[name]);
 }
 
 template<> void Tune::Entry<Value>::init_option() { make_option(name, value, range); }
 
 template<> void Tune::Entry<Value>::read_option() {
-  if (Options.count(name))
-      value = Value(int(Options[name]));
+  if (options().count(name))
+      value = Value(int(options()[name]));
 }
 
 template<> void Tune::Entry<Score>::init_option() {
@@ -99,11 +100,11 @@ template<> void Tune::Entry<Score>::init_option() {
 }
 
 template<> void Tune::Entry<Score>::read_option() {
-  if (Options.count("m" + name))
-      value = make_score(int(Options["m" + name]), eg_value(value));
+  if (options().count("m" + name))
+      value = make_score(int(options()["m" + name]), eg_value(value));
 
-  if (Options.count("e" + name))
-      value = make_score(mg_value(value), int(Options["e" + name]));
+  if (options().count("e" + name))
+      value = make_score(mg_value(value), int(options()["e" + name]));
 }
 
 // Instead of a variable here we have a PostUpdate function: just call it
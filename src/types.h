@@ -37,6 +37,9 @@
 ///
 /// -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 ///               | only in 64-bit mode and requires hardware with pext support.
+///
+/// -DUSE_WASM_SIMD | Use WebAssembly SIMD128 instructions. Requires -msimd128
+///                 | and a host with SIMD support, see pre.js.
 
 #include <cassert>
 #include <cctype>
@@ -79,6 +82,10 @@
 #  define pext(b, m) 0
 #endif
 
+#if defined(USE_WASM_SIMD)
+#  include <wasm_simd128.h> // Header for wasm_*() v128 intrinsics
+#endif
+
 #ifdef USE_POPCNT
 constexpr bool HasPopCnt = true;
 #else
@@ -20,11 +20,26 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <string>
-#include <emscripten.h>
 
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#include <emscripten/heap.h>
+#include <malloc.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+#include "bitboard.h"
+#include "channel.h"
+#include "endgame.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "movegen.h"
 #include "position.h"
@@ -38,11 +53,13 @@ using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
 
-namespace {
+// FEN string of the initial position, normal chess
+const char* UCI::StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
-  // FEN string of the initial position, normal chess
-  const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+namespace {
 
+  // Depth of a batch analysis without depth or nodes limit, see batch()
+  const int BatchDepth = 12;
 
   // position() is called when engine receives the "position" UCI command.
   // The function sets up the position described in the given FEN string ("fen")
@@ -58,7 +75,7 @@ namespace {
 
     if (token == "startpos")
     {
-        fen = StartFEN;
+        fen = UCI::StartFEN;
         is >> token; // Consume "moves" token if any
     }
     else if (token == "fen")
@@ -68,7 +85,7 @@ namespace {
         return;
 
     states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
-    pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+    pos.set(fen, options()["UCI_Chess960"], &states->back(), threads().main());
 
     // Parse move list (if any)
     while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
@@ -96,8 +113,8 @@ namespace {
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
 
-    if (Options.count(name))
-        Options[name] = value;
+    if (options().count(name))
+        options()[name] = value;
     else
         sync_cout << "No such option: " << name << sync_endl;
   }
@@ -133,7 +150,174 @@ namespace {
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
-    Threads.start_thinking(pos, states, limits, ponderMode);
+    threads().start_thinking(pos, states, limits, ponderMode);
+  }
+
+
+  // batch() is the non-UCI command to analyze many positions at once, like all
+  // positions of a game. Each position is searched by a single thread, with the
+  // same limits, see Thread::search_batch(). Time limits do not apply, so the
+  // depth defaults to BatchDepth if neither depth nor nodes are given.
+  // Positions take the same arguments as the 'position' command, and invalid
+  // ones are reported as 'batch <n> error'.
+  // Usage: batch [depth n] [nodes n] position <position> [position <position> ...]
+
+  void batch(istringstream& is) {
+
+    Search::LimitsType limits;
+    Search::Batch entries;
+    std::vector<string> positions;
+    string token;
+
+    limits.startTime = now(); // As early as possible!
+
+    while (is >> token)
+        if (token == "depth")          is >> limits.depth;
+        else if (token == "nodes")     is >> limits.nodes;
+        else if (token == "position")  positions.emplace_back();
+        else if (!positions.empty())   positions.back() += token + " ";
+
+    if (!limits.depth && !limits.nodes)
+        limits.depth = BatchDepth;
+
+    for (const string& args : positions)
+    {
+        Position pos;
+        StateListPtr states;
+        istringstream ss(args);
+
+        position(pos, ss, states);
+        entries.emplace_back(); // Also for invalid arguments, to keep the numbering
+
+        if (!states)
+            continue;
+
+        entries.back().fen = pos.fen();
+        entries.back().chess960 = pos.is_chess960();
+        entries.back().states = std::move(states);
+    }
+
+    if (!entries.empty())
+        threads().start_batch(entries, limits);
+    else
+        sync_cout << "batch done nodes 0 nps 0 time 0" << sync_endl;
+  }
+
+
+  // reserve() is the non-UCI command behind the reserveHash parameter of
+  // pre.js, see TranspositionTable::reserve(). The size is limited to the
+  // maximum of the Hash option, which is all that can be used anyway.
+  // Usage: reserve <mb>
+
+  void reserve(istringstream& is) {
+
+    size_t mb = 0;
+
+    is >> mb;
+
+    tt().reserve(std::min(mb, size_t(options()["Hash"].maximum())));
+  }
+
+
+#ifdef __EMSCRIPTEN__
+  // evalbatch() is the non-UCI command behind evaluateBatch() in pre.js. The
+  // FENs and the results are passed as addresses in the heap, so the command
+  // is only available to JavaScript, see Eval::evaluate_batch().
+  // Usage: evalbatch <id> <fens> <count> <results>
+
+  void evalbatch(istringstream& is) {
+
+    int request = 0;
+    uintptr_t fens = 0, results = 0;
+    size_t count = 0;
+
+    is >> request >> fens >> count >> results;
+
+    if (fens && results)
+        Eval::evaluate_batch(reinterpret_cast<const char*>(fens), count,
+                             reinterpret_cast<int16_t*>(results));
+
+    Channel::complete(request);
+  }
+
+
+  // hashexport() is the command behind exportHash() in pre.js. It passes a
+  // snapshot of the transposition table, see TranspositionTable::serialize(),
+  // in a heap buffer that is freed by pre.js.
+  // Usage: hashexport <id> <min depth> <max age>
+
+  void hashexport(istringstream& is) {
+
+    int request = 0, minDepth = DEPTH_OFFSET, maxAge = 32;
+
+    is >> request >> minDepth >> maxAge;
+
+    threads().main()->wait_for_search_finished();
+
+    string blob = tt().serialize(Depth(minDepth), maxAge);
+    void* data = malloc(blob.size());
+
+    if (data)
+        std::memcpy(data, blob.data(), blob.size());
+
+    Channel::complete(request, data, data ? blob.size() : 0);
+  }
+
+
+  // hashimport() is the command behind importHash() in pre.js. It merges a
+  // snapshot from a heap buffer into the transposition table, and reports
+  // whether the snapshot was valid.
+  // Usage: hashimport <id> <data> <size>
+
+  void hashimport(istringstream& is) {
+
+    int request = 0;
+    uintptr_t data = 0;
+    size_t size = 0;
+
+    is >> request >> data >> size;
+
+    bool ok = data && tt().merge(reinterpret_cast<const char*>(data), size);
+
+    Channel::complete(request, nullptr, ok);
+  }
+#endif
+
+
+  // analyze() is the non-UCI command behind analyze() in pre.js. It searches
+  // the given position like 'position' followed by 'go' would, but leaves the
+  // position of the engine alone, and the result is published as binary
+  // records tagged with the request id (see Channel::publish_result()) instead
+  // of info and bestmove lines.
+  // Usage: analyze <id> [depth n] [nodes n] [movetime n] [multipv n]
+  //        startpos|fen <fen> [moves ...]
+
+  void analyze(istringstream& is) {
+
+    Search::LimitsType limits;
+    Position pos;
+    StateListPtr states;
+    string token;
+
+    limits.startTime = now(); // As early as possible!
+
+    is >> limits.request;
+
+    while (is >> token)
+        if (token == "startpos" || token == "fen") // Needs to be the last on the line
+        {
+            is.seekg(-std::streamoff(token.size()), std::ios_base::cur);
+            position(pos, is, states);
+            break;
+        }
+
+        else if (token == "depth")    is >> limits.depth;
+        else if (token == "nodes")    is >> limits.nodes;
+        else if (token == "movetime") is >> limits.movetime;
+        else if (token == "multipv")  is >> limits.multiPV;
+
+    if (limits.request > 0 && states)
+        threads().start_thinking(pos, states, limits);
   }
 
 
@@ -162,8 +346,8 @@ namespace {
             if (token == "go")
             {
                go(pos, is, states);
-               Threads.main()->wait_for_search_finished();
-               nodes += Threads.nodes_searched();
+               threads().main()->wait_for_search_finished();
+               nodes += threads().nodes_searched();
             }
             else
                sync_cout << "\n" << Eval::trace(pos) << sync_endl;
@@ -181,53 +365,197 @@ namespace {
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+    uint64_t probes = 0, hits = 0;
+
+    for (Thread* th : threads())
+        probes += th->evalCache.probes, hits += th->evalCache.hits;
+
+    if (probes)
+        cerr << "Eval cache hits : " << fixed << setprecision(2) << 100.0 * hits / probes
+             << "% of " << probes << endl;
   }
 
-  // The win rate model returns the probability (per mille) of winning given an eval
-  // and a game-ply. The model fits rather accurately the LTC fishtest statistics.
-  int win_rate_model(Value v, int ply) {
 
-     // The model captures only up to 240 plies, so limit input (and rescale)
-     double m = std::min(240, ply) / 64.0;
+  // busy() answers a command that would wait for the running search instead
+  // of running it. The reader would then not get to the 'stop' that ends an
+  // infinite search, so we report an error, and fail the request if the
+  // command comes from pre.js. Once 'stop' is sent the search is over soon,
+  // and the commands wait for it as usual.
+
+  const std::set<string> WaitingCommands = {
+    "go", "analyze", "batch", "bench", "setoption", "ucinewgame", "reserve",
+    "evalbatch", "hashexport", "hashimport", "memory", "ttstats"
+  };
+
+  bool busy(const string& token, istringstream& is) {
 
-     // Coefficients of a 3rd order polynomial fit based on fishtest data
-     // for two parameters needed to transform eval to the argument of a
-     // logistic function.
-     double as[] = {-8.24404295, 64.23892342, -95.73056462, 153.86478679};
-     double bs[] = {-3.37154371, 28.44489198, -56.67657741,  72.05858751};
-     double a = (((as[0] * m + as[1]) * m + as[2]) * m) + as[3];
-     double b = (((bs[0] * m + bs[1]) * m + bs[2]) * m) + bs[3];
+    if (!threads().running || threads().stop || !WaitingCommands.count(token))
+        return false;
 
-     // Transform eval to centipawns with limited range
-     double x = Utility::clamp(double(100 * v) / PawnValueEg, -1000.0, 1000.0);
+    int request = 0;
 
-     // Return win rate in per mille (rounded to nearest)
-     return int(0.5 + 1000 / (1 + std::exp((a - x) / b)));
+    if (token == "batch")
+        sync_cout << "batch error busy" << sync_endl; // Fails analyzeBatch()
+    else
+        sync_cout << "info string " << token << " is not available during a search" << sync_endl;
+
+    if (   token == "analyze" || token == "evalbatch"
+        || token == "hashexport" || token == "hashimport")
+        is >> request;
+
+    if (request > 0)
+        Channel::reject(request);
+
+    return true;
+  }
+
+
+  // memory() is called when engine receives the "memory" command. It prints
+  // the memory used by the engine in bytes, per component and for each thread,
+  // and on wasm the size of the heap, the bytes allocated in it and the peak
+  // of the memory obtained by malloc. Tables shared by all engines of a
+  // module are marked "(all)".
+
+  void memory() {
+
+    threads().main()->wait_for_search_finished();
+
+    stringstream ss;
+    size_t total = 0, n = 0;
+
+    auto line = [&](const string& name, size_t bytes, bool sum) {
+        ss << (ss.tellp() ? "\n" : "") << left << setw(28) << name << right << setw(12) << bytes;
+        total += sum ? bytes : 0;
+    };
+
+    line("Transposition table", tt().memory(), true);
+    line("Pawn hash, shared", pawns_table().memory(), true);
+    line("Bitboards and magics (all)", Bitboards::memory(), true);
+    line("KPK bitbase (all)", Bitbases::memory(), true);
+    line("Endgame maps (all, approx.)", Endgames::memory(), true);
+
+    for (Thread* th : threads())
+    {
+        size_t size = th == threads().main() ? sizeof(MainThread) : sizeof(Thread);
+        size_t histories =  sizeof(th->counterMoves) + sizeof(th->mainHistory) + sizeof(th->lowPlyHistory)
+                          + sizeof(th->captureHistory) + sizeof(th->continuationHistory);
+
+        ss << "\nThread " << n++;
+        line("  Pawn hash", th->pawnsTable ? th->pawnsTable->memory() : 0, true);
+        line("  Material hash", th->materialTable.memory(), true);
+        line("  Eval cache", th->evalCache.memory(), true);
+        line("  CounterMoveHistory", sizeof(th->counterMoves), false);
+        line("  ButterflyHistory", sizeof(th->mainHistory), false);
+        line("  LowPlyHistory", sizeof(th->lowPlyHistory), false);
+        line("  CapturePieceToHistory", sizeof(th->captureHistory), false);
+        line("  ContinuationHistory x 4", sizeof(th->continuationHistory), false);
+        line("  Other", size - histories, false);
+        line("  Stack", TH_STACK_SIZE, true);
+        total += size;
+    }
+
+    line("Total", total, false);
+
+#ifdef __EMSCRIPTEN__
+    struct mallinfo mi = mallinfo();
+    line("Heap size", emscripten_get_heap_size(), false);
+    line("Heap allocated", size_t(mi.uordblks), false);
+    line("Heap footprint, peak", size_t(mi.usmblks), false); // Obtained from the system, not allocated
+#endif
+
+    sync_cout << ss.str() << sync_endl;
   }
 
 } // namespace
 
 
-/// UCI::loop() waits for a command from stdin, parses it and calls the appropriate
-/// function. Also intercepts EOF from stdin to ensure gracefully exiting if the
-/// GUI dies unexpectedly. When called with some command line arguments, e.g. to
-/// run 'bench', once the command is executed the function returns immediately.
-/// In addition to the UCI ones, also some additional debug commands are supported.
+/// UCI::loop() waits for a command from stdin and executes it. Also intercepts
+/// EOF from stdin to ensure gracefully exiting if the GUI dies unexpectedly.
+/// When called with some command line arguments, e.g. to run 'bench', once the
+/// command is executed the function returns immediately. Only used by native
+/// builds, the browser sends commands through the command ring (see channel.h).
+
+void UCI::loop(int argc, char* argv[]) {
+
+  string token, cmd;
+
+  for (int i = 1; i < argc; ++i)
+      cmd += std::string(argv[i]) + " ";
+
+  do {
+      if (argc == 1 && !getline(cin, cmd)) // Block here waiting for input or EOF
+          cmd = "quit";
+
+      istringstream is(cmd);
+
+      token.clear(); // Avoid a stale if getline() returns empty or blank line
+      is >> skipws >> token;
+
+      execute(cmd);
+
+  } while (token != "quit" && argc == 1); // Command line args are one-shot
+}
+
+
+/// UCI::execute() runs a single command line. Commands for engines other than
+/// the default one are prefixed by '@<id> '. Threads created by a previous
+/// 'setoption name Threads' may not have reached their idle loop yet, in which
+/// case we wait until they do, instead of retrying the command later (B).
+
+void UCI::execute(const string& cmd) {
+
+  int ctx = 0;
+  size_t start = 0;
+
+  if (cmd[0] == '@')
+  {
+      ctx = atoi(cmd.c_str() + 1);
+      start = cmd.find(' ') + 1;
+  }
+
+  if (!start && ctx)
+      return;
+
+  if (!(CurrentEngine = Engine::get(ctx)))
+      return;
+
+  for (Thread* th : threads())
+      if (!th->threadStarted)
+          th->wait_for_search_finished();
+
+  uci_command_ctx(ctx, cmd.c_str() + start);
+}
+
+
+/// uci_command() parses a single command of the default engine and calls the
+/// appropriate function. In addition to the UCI ones, also some additional
+/// debug commands are supported.
 
 EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
+  return uci_command_ctx(0, c_cmd);
+}
+
+
+/// uci_command_ctx() is like uci_command(), but runs the command on the engine
+/// with the given id (see Engine), which becomes the current engine of the
+/// calling thread. 'quit' destroys the engine, unless it is the default one.
+/// Returns 1 if there is no such engine or the command could not be run yet.
+
+EMSCRIPTEN_KEEPALIVE extern "C" int uci_command_ctx(int ctx, const char *c_cmd) {
   std::string cmd(c_cmd);
 
-  static bool initialized = false;
-  static Position pos;
+  Engine* engine = Engine::get(ctx);
   string token;
-  static StateListPtr states(new std::deque<StateInfo>(1));
 
-  if (!initialized) {
-      pos.set(StartFEN, false, &states->back(), Threads.main());
-      initialized = true;
-  }
+  if (!engine)
+      return 1;
+
+  CurrentEngine = engine;
+  Position& pos = engine->pos;
+  StateListPtr& states = engine->states;
 
-  for (Thread* th : Threads) {
+  for (Thread* th : threads()) {
       if (!th->threadStarted)
           return 1;
   }
@@ -237,24 +565,41 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
       token.clear(); // Avoid a stale if getline() returns empty or blank line
       is >> skipws >> token;
 
+      if (busy(token, is))
+          return 0;
+
       if (    token == "quit"
           ||  token == "stop")
-          Threads.stop = true;
+      {
+          threads().stop = true;
+          threads().main()->wake_up();
+      }
 
       // The GUI sends 'ponderhit' to tell us the user has played the expected move.
       // So 'ponderhit' will be sent if we were told to ponder on the same move the
       // user has played. We should continue searching but switch from pondering to
       // normal search.
       else if (token == "ponderhit")
-          Threads.main()->ponder = false; // Switch to normal search
+      {
+          threads().main()->ponder = false; // Switch to normal search
+          threads().main()->wake_up();
+      }
 
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
-                    << "\n"       << Options
+                    << "\n"       << options()
                     << "\nuciok"  << sync_endl;
 
       else if (token == "setoption")  setoption(is);
       else if (token == "go")         go(pos, is, states);
+      else if (token == "analyze")    analyze(is);
+      else if (token == "batch")      batch(is);
+      else if (token == "reserve")    reserve(is);
+#ifdef __EMSCRIPTEN__
+      else if (token == "evalbatch")  evalbatch(is);
+      else if (token == "hashexport") hashexport(is);
+      else if (token == "hashimport") hashimport(is);
+#endif
       else if (token == "position")   position(pos, is, states);
       else if (token == "ucinewgame") Search::clear();
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
@@ -265,10 +610,15 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
       else if (token == "bench")    bench(pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     sync_cout << Eval::trace(pos) << sync_endl;
+      else if (token == "memory")   memory();
+      else if (token == "ttstats")  sync_cout << tt().stats(is >> token && token == "reset") << sync_endl;
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
+  if (token == "quit" && ctx)
+      Engine::destroy(ctx);
+
   return 0;
 }
 
@@ -295,6 +645,31 @@ string UCI::value(Value v) {
 }
 
 
+/// UCI::win_rate_model() returns the probability (per mille) of winning given
+/// an eval and a game-ply. The model fits rather accurately the LTC fishtest
+/// statistics.
+
+int UCI::win_rate_model(Value v, int ply) {
+
+  // The model captures only up to 240 plies, so limit input (and rescale)
+  double m = std::min(240, ply) / 64.0;
+
+  // Coefficients of a 3rd order polynomial fit based on fishtest data
+  // for two parameters needed to transform eval to the argument of a
+  // logistic function.
+  double as[] = {-8.24404295, 64.23892342, -95.73056462, 153.86478679};
+  double bs[] = {-3.37154371, 28.44489198, -56.67657741,  72.05858751};
+  double a = (((as[0] * m + as[1]) * m + as[2]) * m) + as[3];
+  double b = (((bs[0] * m + bs[1]) * m + bs[2]) * m) + bs[3];
+
+  // Transform eval to centipawns with limited range
+  double x = Utility::clamp(double(100 * v) / PawnValueEg, -1000.0, 1000.0);
+
+  // Return win rate in per mille (rounded to nearest)
+  return int(0.5 + 1000 / (1 + std::exp((a - x) / b)));
+}
+
+
 /// UCI::wdl() report WDL statistics given an evaluation and a game ply, based on
 /// data gathered for fishtest LTC games.
 
@@ -57,6 +57,7 @@ public:
   operator double() const;
   operator std::string() const;
   bool operator==(const char*) const;
+  int maximum() const { return max; }
 
 private:
   friend std::ostream& operator<<(std::ostream&, const OptionsMap&);
@@ -69,15 +70,20 @@ private:
 
 void init(OptionsMap&);
 void loop(int argc, char* argv[]);
+void execute(const std::string& cmd);
 std::string value(Value v);
 std::string square(Square s);
 std::string move(Move m, bool chess960);
 std::string pv(const Position& pos, Depth depth, Value alpha, Value beta);
 std::string wdl(Value v, int ply);
+int win_rate_model(Value v, int ply);
 Move to_move(const Position& pos, std::string& str);
 
+extern const char* StartFEN;
+
 } // namespace UCI
 
-extern UCI::OptionsMap Options;
+extern "C" int uci_command(const char* cmd);
+extern "C" int uci_command_ctx(int ctx, const char* cmd);
 
 #endif // #ifndef UCI_H_INCLUDED
@@ -22,7 +22,13 @@
 #include <cassert>
 #include <ostream>
 #include <sstream>
+#include <vector>
 
+#if defined(__EMSCRIPTEN__) && defined(__wasm64__)
+#include <emscripten/heap.h>
+#endif
+
+#include "engine.h"
 #include "misc.h"
 #include "search.h"
 #include "thread.h"
@@ -31,15 +37,16 @@
 
 using std::string;
 
-UCI::OptionsMap Options; // Global object
-
 namespace UCI {
 
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
-void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_hash_size(const Option& o) { tt().resize(size_t(o)); }
+void on_pawn_hash(const Option& o) { pawns_table().resize(size_t(o)); }
+void on_eval_cache(const Option& o) { threads().set_eval_cache(size_t(o)); }
 void on_logger(const Option& o) { start_logger(o); }
-void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_output_interval(const Option& o) { set_output_interval(o); }
+void on_threads(const Option& o) { threads().set(size_t(o)); }
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -54,15 +61,30 @@ bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const
 
 void init(OptionsMap& o) {
 
-  // Emscripten: Limited by WASM_MAX_MEMORY.
+  // Emscripten: Limited by MAXIMUM_MEMORY, see Makefile. The memory64 build
+  // (ARCH=wasm64) can use the whole heap, but for about 1 GB kept for threads,
+  // pawn and material tables and the other buffers of the engine.
+#if defined(__EMSCRIPTEN__) && defined(__wasm64__)
+  const int MaxHashMB = int(emscripten_get_heap_max() / (1024 * 1024)) - 1024;
+#else
   constexpr int MaxHashMB = 1024;
+#endif
+
+  // Emscripten: Batch info lines to about one per frame by default.
+#ifdef __EMSCRIPTEN__
+  constexpr int OutputInterval = 16;
+#else
+  constexpr int OutputInterval = 0;
+#endif
 
   o["Debug Log File"]        << Option("", on_logger);
   o["Contempt"]              << Option(24, -100, 100);
   o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
   o["Threads"]               << Option(1, 1, 32, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
+  o["Pawn Hash"]             << Option(0, 0, MaxHashMB, on_pawn_hash);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Eval Cache"]            << Option(0, 0, 256, on_eval_cache);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -74,31 +96,40 @@ void init(OptionsMap& o) {
   o["UCI_LimitStrength"]     << Option(false);
   o["UCI_Elo"]               << Option(1350, 1350, 2850);
   o["UCI_ShowWDL"]           << Option(false);
+  o["Binary Info"]           << Option(false);
+  o["Output Interval"]       << Option(OutputInterval, 0, 5000, on_output_interval);
 }
 
 
 /// operator<<() is used to print all the options default values in chronological
 /// insertion order (the idx field) and in the format defined by the UCI protocol.
+/// The insertion counter is shared by all engines, so indices of an engine's
+/// options need not start at zero.
 
 std::ostream& operator<<(std::ostream& os, const OptionsMap& om) {
 
-  for (size_t idx = 0; idx < om.size(); ++idx)
-      for (const auto& it : om)
-          if (it.second.idx == idx)
-          {
-              const Option& o = it.second;
-              os << "\noption name " << it.first << " type " << o.type;
+  std::vector<const OptionsMap::value_type*> ordered;
 
-              if (o.type == "string" || o.type == "check" || o.type == "combo")
-                  os << " default " << o.defaultValue;
+  for (const auto& it : om)
+      ordered.push_back(&it);
 
-              if (o.type == "spin")
-                  os << " default " << int(stof(o.defaultValue))
-                     << " min "     << o.min
-                     << " max "     << o.max;
+  std::sort(ordered.begin(), ordered.end(),
+            [](const OptionsMap::value_type* a, const OptionsMap::value_type* b) {
+                return a->second.idx < b->second.idx; });
 
-              break;
-          }
+  for (const auto* it : ordered)
+  {
+      const Option& o = it->second;
+      os << "\noption name " << it->first << " type " << o.type;
+
+      if (o.type == "string" || o.type == "check" || o.type == "combo")
+          os << " default " << o.defaultValue;
+
+      if (o.type == "spin")
+          os << " default " << int(stof(o.defaultValue))
+             << " min "     << o.min
+             << " max "     << o.max;
+  }
 
   return os;
 }
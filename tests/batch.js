@@ -0,0 +1,49 @@
+#!/usr/bin/env node
+// Batch analysis of a long game with the WebAssembly build. The batch of all
+// positions of a 240 ply game is a single command of about 150 KB, more than
+// the command ring holds (see channel.h), so it has to be written in parts.
+//
+// Usage: node tests/batch.js [module] [simd]   (default ./stockfish.js yes)
+//
+// With simd no, stockfish.wasm is loaded even where SIMD is supported, for
+// builds without stockfish-simd.wasm like ARCH=wasm64.
+
+const path = require('path');
+
+const PLIES = 240;
+
+function error(message) {
+  console.error(`batch testing failed: ${message}`);
+  process.exit(1);
+}
+
+async function main() {
+  const Stockfish = require(path.resolve(process.argv[2] || './stockfish.js'));
+  const sf = await Stockfish({ simd: process.argv[3] !== 'no' });
+
+  // Knights out and back, legal for as long as we like
+  const shuffle = ['g1f3', 'g8f6', 'f3g1', 'f6g8'];
+  const moves = [];
+  for (let i = 0; i < PLIES; i++) moves.push(shuffle[i % shuffle.length]);
+
+  const positions = [];
+  for (let i = 0; i <= PLIES; i++) positions.push({ fen: 'startpos', moves: moves.slice(0, i) });
+
+  const timeout = setTimeout(() => error('timeout'), 60000);
+
+  const results = await sf.analyzeBatch(positions, { depth: 1 });
+  if (results.length !== positions.length) error(`${results.length} results`);
+  for (let i = 0; i < results.length; i++)
+    if (!results[i] || !results[i].pv.length) error(`no result for ply ${i}`);
+
+  // The reader is still in sync with the commands after the long one
+  const result = await sf.analyze('startpos', { depth: 1 });
+  if (!result.bestmove) error('no best move after the batch');
+
+  clearTimeout(timeout);
+  console.log('batch testing OK');
+  sf.terminate();
+  process.exit(0);
+}
+
+main().catch(err => error(err));